@@ -0,0 +1,193 @@
+#include <stdlib.h>         /* standard library                         */
+#include <string.h>         /* string functions                         */
+#include <stdint.h>         /* fixed width integers                     */
+
+/* Own header */
+#include "arena.h"          /* arena header                             */
+
+#define SLAB_LARGE (-1)     /* class of slabs above the largest class   */
+
+/* Prefix of every slab, keeps the payload aligned like malloc */
+typedef union slab_header {
+    struct {
+        union slab_header *next;    /* free list                        */
+        int class;                  /* size class or SLAB_LARGE         */
+        size_t size;                /* size with the header             */
+    } s;
+    max_align_t align;
+} slab_header;
+
+struct arena_chunk {
+    arena_chunk *next;              /* older chunks                     */
+    size_t size;                    /* usable bytes                     */
+    size_t used;                    /* bytes handed out                 */
+    max_align_t data[];
+};
+
+static slab_header *free_slabs[SLAB_CLASSES];  /* recycled slabs by class  */
+static slab_stats stats;
+
+int slab_class(size_t size);
+void count_slab(size_t size, int taken);
+
+
+void * slab_alloc(size_t size)
+{
+    slab_header *slab;
+    int class = slab_class(size + sizeof(slab_header));
+
+    if (class != SLAB_LARGE && free_slabs[class] != NULL)
+    {
+        slab = free_slabs[class];
+        free_slabs[class] = slab->s.next;
+        stats.cached -= slab->s.size;
+        stats.in_use += slab->s.size;
+        ++stats.reused;
+        return slab + 1;
+    }
+
+    size = (class == SLAB_LARGE) ? size + sizeof(slab_header) : (size_t) 1 << (class + SLAB_MINSHIFT);
+    slab = malloc(size);
+    if (slab == NULL)
+    {
+        return NULL;
+    }
+    slab->s.class = class;
+    slab->s.size = size;
+    count_slab(size, 1);
+    return slab + 1;
+}
+
+void slab_free(void *ptr)
+{
+    slab_header *slab;
+
+    if (ptr == NULL)
+    {
+        return;
+    }
+    slab = (slab_header *) ptr - 1;
+
+    if (slab->s.class == SLAB_LARGE)
+    {
+        count_slab(slab->s.size, 0);
+        free(slab);
+        return;
+    }
+
+    slab->s.next = free_slabs[slab->s.class];
+    free_slabs[slab->s.class] = slab;
+    stats.in_use -= slab->s.size;
+    stats.cached += slab->s.size;
+}
+
+void slab_trim()
+{
+    slab_header *slab;
+    int i;
+
+    for (i = 0; i < SLAB_CLASSES; ++i)
+    {
+        while ( (slab = free_slabs[i]) != NULL)
+        {
+            free_slabs[i] = slab->s.next;
+            stats.cached -= slab->s.size;
+            free(slab);
+        }
+    }
+}
+
+void slab_get_stats(slab_stats *out)
+{
+    *out = stats;
+}
+
+
+void arena_init(arena *a)
+{
+    a->chunks = NULL;
+    a->used = 0;
+}
+
+size_t arena_fit(size_t slab_size)
+{
+    return slab_size - sizeof(slab_header) - sizeof(arena_chunk);
+}
+
+void * arena_alloc(arena *a, size_t size)
+{
+    arena_chunk *chunk = a->chunks;
+    size_t usable = ARENA_CHUNKSIZE - sizeof(slab_header) - sizeof(arena_chunk);
+    void *ptr;
+
+    /* Keep every allocation aligned like malloc */
+    size = (size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+
+    if (chunk == NULL || chunk->size - chunk->used < size)
+    {
+        /* Oversized requests get a chunk of their own */
+        if (size > usable)
+        {
+            usable = size;
+        }
+        chunk = slab_alloc(sizeof(arena_chunk) + usable);
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+        chunk->size = usable;
+        chunk->used = 0;
+        chunk->next = a->chunks;
+        a->chunks = chunk;
+    }
+
+    ptr = (char *) chunk->data + chunk->used;
+    chunk->used += size;
+    a->used += size;
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+void arena_reset(arena *a)
+{
+    arena_chunk *chunk;
+
+    while ( (chunk = a->chunks) != NULL)
+    {
+        a->chunks = chunk->next;
+        slab_free(chunk);
+    }
+    a->used = 0;
+}
+
+
+/* Smallest class that holds size bytes */
+int slab_class(size_t size)
+{
+    int class = 0;
+
+    while (((size_t) 1 << (class + SLAB_MINSHIFT)) < size)
+    {
+        if (++class >= SLAB_CLASSES)
+        {
+            return SLAB_LARGE;
+        }
+    }
+    return class;
+}
+
+void count_slab(size_t size, int taken)
+{
+    if (taken)
+    {
+        stats.in_use += size;
+        if (stats.in_use + stats.cached > stats.peak)
+        {
+            stats.peak = stats.in_use + stats.cached;
+        }
+    }
+    else
+    {
+        stats.in_use -= size;
+    }
+}
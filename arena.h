@@ -0,0 +1,46 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>         /* size_t                                   */
+
+#define SLAB_MINSHIFT 6                     /* smallest slab, 64 bytes          */
+#define SLAB_MAXSHIFT 17                    /* largest pooled slab, 128 KB      */
+#define SLAB_CLASSES (SLAB_MAXSHIFT - SLAB_MINSHIFT + 1)
+#define ARENA_CHUNKSIZE 4096                /* slab size behind an arena        */
+
+/* Bytes taken from the process heap by the slab pool */
+typedef struct {
+    size_t in_use;              /* handed out slabs                     */
+    size_t cached;              /* freed slabs kept for reuse           */
+    size_t peak;                /* highest in_use + cached              */
+    unsigned long reused;       /* allocations served from the cache    */
+} slab_stats;
+
+/* Bump allocator over slabs, everything is freed at once by arena_reset */
+typedef struct arena_chunk arena_chunk;
+typedef struct {
+    arena_chunk *chunks;        /* newest first, allocations come from it */
+    size_t used;                /* bytes handed out since the reset       */
+} arena;
+
+/* Power of two slabs recycled through per size free lists, not thread safe */
+void * slab_alloc(size_t size);
+void slab_free(void *ptr);
+
+/* Give the cached slabs back to the heap, the connection went idle */
+void slab_trim();
+
+void slab_get_stats(slab_stats *stats);
+
+void arena_init(arena *a);
+
+/* Largest allocation whose chunk is exactly a slab of slab_size, a power of two */
+size_t arena_fit(size_t slab_size);
+
+/* Zeroed, aligned for any type, NULL if out of memory */
+void * arena_alloc(arena *a, size_t size);
+
+/* Hand every chunk back to the slab pool */
+void arena_reset(arena *a);
+
+#endif
@@ -1,6 +1,7 @@
 #include <stdio.h>      /* standard input output    */
 #include <stdlib.h>     /* standard library import  */
 #include <string.h>     /* string functions         */
+#include <sys/mman.h>   /* for mmap                 */
 
 /* Own header */
 #include "config.h"     /* config header */
@@ -13,11 +14,22 @@
 #define CONFIG_CGI_CMD "CGI_CMD"
 #define CONFIG_CGI_DIR "CGI_DIR"
 #define CONFIG_SYSLOG_NAME "SYSLOG_NAME"
+#define CONFIG_ROOT_PACK "ROOT_PACK"
+#define CONFIG_ERR_PACK "ERR_PACK"
 #define CONFIG_DNS "DNS"
+#define CONFIG_RATE_CONNS "RATE_CONNS"
+#define CONFIG_RATE_STATIC "RATE_STATIC"
+#define CONFIG_RATE_STATIC_BURST "RATE_STATIC_BURST"
+#define CONFIG_RATE_CGI "RATE_CGI"
+#define CONFIG_RATE_CGI_BURST "RATE_CGI_BURST"
+#define CONFIG_IO_THREADS "IO_THREADS"
+#define CONFIG_IO_QUEUE "IO_QUEUE"
+#define CONFIG_TRACE_LOG "TRACE_LOG"
+#define CONFIG_TRACE_SLOWEST "TRACE_SLOWEST"
 
 /* Function declarations */
 int parse_line(const char *line, config *conf);
-int check_config(config conf);
+int check_config(const config *conf);
 
 int load_config(const char *filename, config *conf)
 {
@@ -46,7 +58,7 @@ int load_config(const char *filename, config *conf)
 
     fclose(fp);
 
-    return check_config(*conf);
+    return check_config(conf);
 }
 
 int parse_line(const char *line, config *conf)
@@ -113,48 +125,139 @@ int parse_line(const char *line, config *conf)
         {
             strncpy(conf->syslog_name, value, PATHSIZE);
         }
+        /* HTML root pack file */
+        else if (strncmp(key, CONFIG_ROOT_PACK, PATHSIZE) == 0)
+        {
+            strncpy(conf->root_pack, value, PATHSIZE);
+        }
+        /* Error HTML pack file */
+        else if (strncmp(key, CONFIG_ERR_PACK, PATHSIZE) == 0)
+        {
+            strncpy(conf->err_pack, value, PATHSIZE);
+        }
         /* DNS resolution */
         else if (strncmp(key, CONFIG_DNS, PATHSIZE) == 0)
         {
             conf->dns = atoi(value);
         }
+        /* Concurrent connections per client */
+        else if (strncmp(key, CONFIG_RATE_CONNS, PATHSIZE) == 0)
+        {
+            conf->rate_conns = atoi(value);
+        }
+        /* Static request rate per client */
+        else if (strncmp(key, CONFIG_RATE_STATIC, PATHSIZE) == 0)
+        {
+            conf->rate_static = atoi(value);
+        }
+        /* Static request burst per client */
+        else if (strncmp(key, CONFIG_RATE_STATIC_BURST, PATHSIZE) == 0)
+        {
+            conf->rate_static_burst = atoi(value);
+        }
+        /* CGI request rate per client */
+        else if (strncmp(key, CONFIG_RATE_CGI, PATHSIZE) == 0)
+        {
+            conf->rate_cgi = atoi(value);
+        }
+        /* CGI request burst per client */
+        else if (strncmp(key, CONFIG_RATE_CGI_BURST, PATHSIZE) == 0)
+        {
+            conf->rate_cgi_burst = atoi(value);
+        }
+        /* File system threads */
+        else if (strncmp(key, CONFIG_IO_THREADS, PATHSIZE) == 0)
+        {
+            conf->io_threads = atoi(value);
+        }
+        /* File system queue depth */
+        else if (strncmp(key, CONFIG_IO_QUEUE, PATHSIZE) == 0)
+        {
+            conf->io_queue = atoi(value);
+        }
+        /* Stage timings in the access log */
+        else if (strncmp(key, CONFIG_TRACE_LOG, PATHSIZE) == 0)
+        {
+            conf->trace_log = atoi(value);
+        }
+        /* Slowest requests kept for the dump */
+        else if (strncmp(key, CONFIG_TRACE_SLOWEST, PATHSIZE) == 0)
+        {
+            conf->trace_slowest = atoi(value);
+        }
     }
     return EXIT_SUCCESS;
 }
 
-int check_config(config conf)
+int check_config(const config *conf)
 {
-    if (conf.port <= 0)
+    if (conf->port <= 0)
+    {
+        return EXIT_FAILURE;
+    }
+    else if (conf->maxconns <= 0)
+    {
+        return EXIT_FAILURE;
+    }
+    else if (conf->user == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    else if (conf->root_dir == NULL)
     {
         return EXIT_FAILURE;
     }
-    else if (conf.maxconns <= 0)
+    else if (conf->err_dir == NULL)
     {
         return EXIT_FAILURE;
     }
-    else if (conf.user == NULL)
+    else if (conf->cgi_dir == NULL)
     {
         return EXIT_FAILURE;
     }
-    else if (conf.root_dir == NULL)
+    else if (conf->syslog_name == NULL)
     {
         return EXIT_FAILURE;
     }
-    else if (conf.err_dir == NULL)
+    else if (conf->dns != 0 && conf->dns != 1)
     {
         return EXIT_FAILURE;
     }
-    else if (conf.cgi_dir == NULL)
+    else if (conf->rate_conns < 0 || conf->rate_static < 0 || conf->rate_static_burst < 0 ||
+             conf->rate_cgi < 0 || conf->rate_cgi_burst < 0)
     {
         return EXIT_FAILURE;
     }
-    else if (conf.syslog_name == NULL)
+    else if (conf->io_threads < 0 || conf->io_queue < 0)
     {
         return EXIT_FAILURE;
     }
-    else if (conf.dns != 0 && conf.dns != 1)
+    else if ((conf->trace_log != 0 && conf->trace_log != 1) || conf->trace_slowest < 0)
     {
         return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;
+}
+
+/* Copy the config to a read only page, forked processes share it instead of a copy */
+const config * config_snapshot(const config *conf)
+{
+    config *shared;
+
+    shared = mmap(NULL, sizeof(config), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+    {
+        perror("Config mapping failed!");
+        return NULL;
+    }
+    memcpy(shared, conf, sizeof(config));
+
+    /* A write through the snapshot faults instead of diverging between processes */
+    if ( (mprotect(shared, sizeof(config), PROT_READ)) == -1)
+    {
+        perror("Config protection failed!");
+        munmap(shared, sizeof(config));
+        return NULL;
+    }
+    return shared;
 }
\ No newline at end of file
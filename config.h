@@ -12,9 +12,23 @@ typedef struct {
    char cgi_cmd[PATHSIZE];      /* cgi command                  */
    char cgi_dir[PATHSIZE];      /* cgi root directory           */
    char syslog_name[PATHSIZE];  /* syslog name                  */
+   char root_pack[PATHSIZE];    /* html root pack file          */
+   char err_pack[PATHSIZE];     /* error html pack file         */
    int  dns;                    /* dns resolution               */
+   int  rate_conns;             /* concurrent connections per IP */
+   int  rate_static;            /* static requests per second   */
+   int  rate_static_burst;      /* static request burst size    */
+   int  rate_cgi;               /* cgi requests per second      */
+   int  rate_cgi_burst;         /* cgi request burst size       */
+   int  io_threads;             /* file system threads          */
+   int  io_queue;               /* file system queue depth      */
+   int  trace_log;              /* stage timings in access log  */
+   int  trace_slowest;          /* slowest requests kept        */
 } config;
 
 int load_config(const char *filename, config *conf);
 
+/* Read only snapshot shared by every process, pass it by pointer */
+const config * config_snapshot(const config *conf);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,471 @@
+#include <stdio.h>          /* standard input output                    */
+#include <stdlib.h>         /* standard library                         */
+#include <string.h>         /* string functions                         */
+
+/* Own header */
+#include "hpack.h"          /* hpack header                             */
+
+#define HUFFMAN_SYMBOLS 257 /* 256 octets and EOS                       */
+#define HUFFMAN_MAXLEN 30   /* longest code                             */
+#define HUFFMAN_EOS 256
+
+#define STATIC_ENTRIES 61
+
+/* RFC 7541 Appendix A */
+static const struct {
+    const char *name;
+    const char *value;
+} static_table[STATIC_ENTRIES] = {
+    {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"},
+    {":path", "/index.html"}, {":scheme", "http"}, {":scheme", "https"}, {":status", "200"},
+    {":status", "204"}, {":status", "206"}, {":status", "304"}, {":status", "400"},
+    {":status", "404"}, {":status", "500"}, {"accept-charset", ""}, {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""}, {"accept-ranges", ""}, {"accept", ""}, {"access-control-allow-origin", ""},
+    {"age", ""}, {"allow", ""}, {"authorization", ""}, {"cache-control", ""},
+    {"content-disposition", ""}, {"content-encoding", ""}, {"content-language", ""}, {"content-length", ""},
+    {"content-location", ""}, {"content-range", ""}, {"content-type", ""}, {"cookie", ""},
+    {"date", ""}, {"etag", ""}, {"expect", ""}, {"expires", ""},
+    {"from", ""}, {"host", ""}, {"if-match", ""}, {"if-modified-since", ""},
+    {"if-none-match", ""}, {"if-range", ""}, {"if-unmodified-since", ""}, {"last-modified", ""},
+    {"link", ""}, {"location", ""}, {"max-forwards", ""}, {"proxy-authenticate", ""},
+    {"proxy-authorization", ""}, {"range", ""}, {"referer", ""}, {"refresh", ""},
+    {"retry-after", ""}, {"server", ""}, {"set-cookie", ""}, {"strict-transport-security", ""},
+    {"transfer-encoding", ""}, {"user-agent", ""}, {"vary", ""}, {"via", ""},
+    {"www-authenticate", ""}
+};
+
+/* RFC 7541 Appendix B code lengths, the code is canonical so the codes follow from them */
+static const uint8_t huffman_len[HUFFMAN_SYMBOLS] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+     6, 10, 10, 12, 13,  6,  8, 11, 10, 10,  8, 11,  8,  6,  6,  6,
+     5,  5,  5,  6,  6,  6,  6,  6,  6,  6,  7,  8, 15,  6, 12, 10,
+    13,  6,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,
+     7,  7,  7,  7,  7,  7,  7,  7,  8,  7,  8, 13, 19, 13, 14,  6,
+    15,  5,  6,  5,  6,  5,  6,  6,  6,  5,  7,  7,  6,  6,  6,  5,
+     6,  7,  6,  5,  5,  6,  7,  7,  7,  7,  7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30
+};
+
+/* Canonical decoding tables, built on first use */
+static uint16_t huffman_sym[HUFFMAN_SYMBOLS];       /* symbols ordered by code    */
+static uint32_t huffman_first[HUFFMAN_MAXLEN + 1];  /* first code of a length     */
+static uint16_t huffman_count[HUFFMAN_MAXLEN + 1];  /* number of codes of a length */
+static uint16_t huffman_offset[HUFFMAN_MAXLEN + 1]; /* first symbol of a length   */
+static int huffman_ready = 0;
+
+static void huffman_init();
+static int huffman_decode(const uint8_t *in, size_t len, char *out, size_t size, size_t *out_len);
+static int decode_int(const uint8_t **p, const uint8_t *end, int prefix, uint32_t *value);
+static int decode_string(const uint8_t **p, const uint8_t *end, char *out, size_t *out_len);
+static int get_field(hpack_table *table, uint32_t index, const char **name, size_t *name_len,
+    const char **value, size_t *value_len);
+static int insert_field(hpack_table *table, const char *name, size_t name_len,
+    const char *value, size_t value_len);
+static void evict(hpack_table *table, size_t max_size);
+static size_t encode_int(uint8_t *out, size_t size, int prefix, uint8_t flags, uint32_t value);
+
+
+void hpack_init(hpack_table *table)
+{
+    memset(table, 0, sizeof(hpack_table));
+    table->head = HPACK_MAXENTRIES - 1;
+    table->max_size = HPACK_TABLESIZE;
+
+    if (!huffman_ready)
+    {
+        huffman_init();
+    }
+}
+
+void hpack_free(hpack_table *table)
+{
+    evict(table, 0);
+}
+
+int hpack_decode(hpack_table *table, const uint8_t *block, size_t len,
+    hpack_callback callback, void *arg)
+{
+    const uint8_t *p = block;
+    const uint8_t *end = block + len;
+    char name_buf[HPACK_STRSIZE];
+    char value_buf[HPACK_STRSIZE];
+    const char *name;
+    const char *value;
+    size_t name_len;
+    size_t value_len;
+    uint32_t index;
+    int incremental;
+
+    while (p < end)
+    {
+        /* Indexed header field */
+        if (*p & 0x80)
+        {
+            if ( (decode_int(&p, end, 7, &index)) != EXIT_SUCCESS ||
+                 (get_field(table, index, &name, &name_len, &value, &value_len)) != EXIT_SUCCESS)
+            {
+                return EXIT_FAILURE;
+            }
+            callback(arg, name, name_len, value, value_len);
+            continue;
+        }
+
+        /* Dynamic table size update */
+        if ( (*p & 0xe0) == 0x20)
+        {
+            if ( (decode_int(&p, end, 5, &index)) != EXIT_SUCCESS || index > HPACK_TABLESIZE)
+            {
+                return EXIT_FAILURE;
+            }
+            table->max_size = index;
+            evict(table, table->max_size);
+            continue;
+        }
+
+        /* Literal header field, with incremental indexing or without / never indexed */
+        incremental = ( (*p & 0xc0) == 0x40);
+        if ( (decode_int(&p, end, incremental ? 6 : 4, &index)) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+
+        if (index == 0)
+        {
+            if ( (decode_string(&p, end, name_buf, &name_len)) != EXIT_SUCCESS)
+            {
+                return EXIT_FAILURE;
+            }
+            name = name_buf;
+        }
+        else if ( (get_field(table, index, &name, &name_len, &value, &value_len)) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+
+        if ( (decode_string(&p, end, value_buf, &value_len)) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+        value = value_buf;
+
+        callback(arg, name, name_len, value, value_len);
+
+        if (incremental &&
+            (insert_field(table, name, name_len, value, value_len)) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+    } /* end while */
+
+    return EXIT_SUCCESS;
+}
+
+size_t hpack_encode_status(uint8_t *out, size_t size, int status_code)
+{
+    char value[4];
+    int i;
+
+    /* Indexed if the static table has it */
+    for (i = HPACK_STATUS; i <= HPACK_STATUS + 6; ++i)
+    {
+        if (atoi(static_table[i - 1].value) == status_code)
+        {
+            return encode_int(out, size, 7, 0x80, i);
+        }
+    }
+
+    snprintf(value, sizeof(value), "%03d", status_code);
+    return hpack_encode_field(out, size, HPACK_STATUS, value);
+}
+
+/* Literal header field without indexing, indexed name, plain string */
+size_t hpack_encode_field(uint8_t *out, size_t size, int name_index, const char *value)
+{
+    size_t value_len = strlen(value);
+    size_t len;
+    size_t n;
+
+    if ( (len = encode_int(out, size, 4, 0x00, name_index)) == 0 ||
+         (n = encode_int(out + len, size - len, 7, 0x00, value_len)) == 0)
+    {
+        return 0;
+    }
+    len += n;
+
+    if (value_len > size - len)
+    {
+        return 0;
+    }
+    memcpy(out + len, value, value_len);
+    return len + value_len;
+}
+
+
+static void huffman_init()
+{
+    uint32_t code = 0;
+    int n = 0;
+    int len;
+    int i;
+
+    for (len = 1; len <= HUFFMAN_MAXLEN; ++len)
+    {
+        huffman_first[len] = code;
+        huffman_offset[len] = n;
+        for (i = 0; i < HUFFMAN_SYMBOLS; ++i)
+        {
+            if (huffman_len[i] == len)
+            {
+                huffman_sym[n++] = i;
+            }
+        }
+        huffman_count[len] = n - huffman_offset[len];
+        code = (code + huffman_count[len]) << 1;
+    } /* end for */
+
+    huffman_ready = 1;
+}
+
+static int huffman_decode(const uint8_t *in, size_t len, char *out, size_t size, size_t *out_len)
+{
+    uint32_t code = 0;
+    int bits = 0;
+    size_t n = 0;
+    size_t i;
+    int bit;
+    uint16_t sym;
+
+    for (i = 0; i < len; ++i)
+    {
+        for (bit = 7; bit >= 0; --bit)
+        {
+            code = (code << 1) | ((in[i] >> bit) & 1);
+            ++bits;
+
+            if (code >= huffman_first[bits] && code - huffman_first[bits] < huffman_count[bits])
+            {
+                sym = huffman_sym[huffman_offset[bits] + code - huffman_first[bits]];
+                if (sym == HUFFMAN_EOS || n >= size)
+                {
+                    return EXIT_FAILURE;
+                }
+                out[n++] = sym;
+                code = 0;
+                bits = 0;
+            }
+            else if (bits == HUFFMAN_MAXLEN)
+            {
+                return EXIT_FAILURE;
+            }
+        } /* end for */
+    } /* end for */
+
+    /* Padding is the most significant bits of EOS, shorter than 8 bits */
+    if (bits > 7 || code != (1U << bits) - 1)
+    {
+        return EXIT_FAILURE;
+    }
+
+    *out_len = n;
+    return EXIT_SUCCESS;
+}
+
+static int decode_int(const uint8_t **p, const uint8_t *end, int prefix, uint32_t *value)
+{
+    uint32_t max = (1U << prefix) - 1;
+    uint32_t v;
+    uint8_t b;
+    int shift = 0;
+
+    if (*p >= end)
+    {
+        return EXIT_FAILURE;
+    }
+
+    v = *(*p)++ & max;
+    if (v < max)
+    {
+        *value = v;
+        return EXIT_SUCCESS;
+    }
+
+    do
+    {
+        if (*p >= end || shift > 21)
+        {
+            return EXIT_FAILURE;
+        }
+        b = *(*p)++;
+        v += (uint32_t) (b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+
+    *value = v;
+    return EXIT_SUCCESS;
+}
+
+static int decode_string(const uint8_t **p, const uint8_t *end, char *out, size_t *out_len)
+{
+    int huffman;
+    uint32_t len;
+
+    if (*p >= end)
+    {
+        return EXIT_FAILURE;
+    }
+    huffman = **p & 0x80;
+
+    if ( (decode_int(p, end, 7, &len)) != EXIT_SUCCESS || len > (size_t) (end - *p))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (huffman)
+    {
+        if ( (huffman_decode(*p, len, out, HPACK_STRSIZE, out_len)) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        if (len > HPACK_STRSIZE)
+        {
+            return EXIT_FAILURE;
+        }
+        memcpy(out, *p, len);
+        *out_len = len;
+    }
+
+    *p += len;
+    return EXIT_SUCCESS;
+}
+
+static int get_field(hpack_table *table, uint32_t index, const char **name, size_t *name_len,
+    const char **value, size_t *value_len)
+{
+    hpack_field *field;
+
+    if (index == 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (index <= STATIC_ENTRIES)
+    {
+        *name = static_table[index - 1].name;
+        *name_len = strlen(*name);
+        *value = static_table[index - 1].value;
+        *value_len = strlen(*value);
+        return EXIT_SUCCESS;
+    }
+
+    index -= STATIC_ENTRIES + 1;
+    if (index >= (uint32_t) table->count)
+    {
+        return EXIT_FAILURE;
+    }
+
+    field = &table->entries[(table->head - index + HPACK_MAXENTRIES) % HPACK_MAXENTRIES];
+    *name = field->name;
+    *name_len = field->name_len;
+    *value = field->value;
+    *value_len = field->value_len;
+    return EXIT_SUCCESS;
+}
+
+static int insert_field(hpack_table *table, const char *name, size_t name_len,
+    const char *value, size_t value_len)
+{
+    size_t size = name_len + value_len + 32;
+    hpack_field *field;
+    char *buffer;
+
+    /* Too large, it empties the table (RFC 7541 4.4) */
+    if (size > table->max_size)
+    {
+        evict(table, 0);
+        return EXIT_SUCCESS;
+    }
+
+    /* Copy first, the name can point into an entry that is evicted */
+    buffer = malloc(name_len + value_len);
+    if (buffer == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    memcpy(buffer, name, name_len);
+    memcpy(buffer + name_len, value, value_len);
+
+    evict(table, table->max_size - size);
+
+    table->head = (table->head + 1) % HPACK_MAXENTRIES;
+    field = &table->entries[table->head];
+    field->name = buffer;
+    field->name_len = name_len;
+    field->value = buffer + name_len;
+    field->value_len = value_len;
+    table->size += size;
+    ++table->count;
+
+    return EXIT_SUCCESS;
+}
+
+/* Drop the oldest entries until the table fits into max_size */
+static void evict(hpack_table *table, size_t max_size)
+{
+    hpack_field *field;
+
+    while (table->count > 0 && table->size > max_size)
+    {
+        field = &table->entries[(table->head - table->count + 1 + HPACK_MAXENTRIES) % HPACK_MAXENTRIES];
+        table->size -= field->name_len + field->value_len + 32;
+        free(field->name);
+        memset(field, 0, sizeof(hpack_field));
+        --table->count;
+    }
+}
+
+static size_t encode_int(uint8_t *out, size_t size, int prefix, uint8_t flags, uint32_t value)
+{
+    uint32_t max = (1U << prefix) - 1;
+    size_t len = 0;
+
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    if (value < max)
+    {
+        out[len++] = flags | value;
+        return len;
+    }
+
+    out[len++] = flags | max;
+    value -= max;
+    while (value >= 0x80)
+    {
+        if (len >= size)
+        {
+            return 0;
+        }
+        out[len++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    if (len >= size)
+    {
+        return 0;
+    }
+    out[len++] = value;
+    return len;
+}
@@ -0,0 +1,47 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stdint.h>         /* fixed width integers                     */
+#include <stddef.h>         /* size_t                                   */
+
+#define HPACK_TABLESIZE 4096                        /* SETTINGS_HEADER_TABLE_SIZE   */
+#define HPACK_MAXENTRIES (HPACK_TABLESIZE / 32)     /* every entry costs 32+ bytes  */
+#define HPACK_STRSIZE 4096                          /* longest decoded name/value   */
+
+/* Static table indexes used by the encoder */
+#define HPACK_STATUS 8
+#define HPACK_CONTENT_LENGTH 28
+#define HPACK_CONTENT_TYPE 31
+
+typedef struct {
+    char *name;         /* name and value share one allocation  */
+    char *value;
+    size_t name_len;
+    size_t value_len;
+} hpack_field;
+
+/* Dynamic table of the decoder, a ring with the newest entry at head */
+typedef struct {
+    hpack_field entries[HPACK_MAXENTRIES];
+    int head;           /* index of the newest entry            */
+    int count;          /* number of entries                    */
+    size_t size;        /* size as defined by RFC 7541 4.1      */
+    size_t max_size;    /* current maximum size                 */
+} hpack_table;
+
+/* Called for every decoded header field */
+typedef void (*hpack_callback)(void *arg, const char *name, size_t name_len,
+    const char *value, size_t value_len);
+
+void hpack_init(hpack_table *table);
+void hpack_free(hpack_table *table);
+
+/* Decode a complete header block, EXIT_FAILURE is a compression error */
+int hpack_decode(hpack_table *table, const uint8_t *block, size_t len,
+    hpack_callback callback, void *arg);
+
+/* Encode into out, return the encoded length or 0 if it does not fit */
+size_t hpack_encode_status(uint8_t *out, size_t size, int status_code);
+size_t hpack_encode_field(uint8_t *out, size_t size, int name_index, const char *value);
+
+#endif
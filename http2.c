@@ -0,0 +1,1422 @@
+#include <stdio.h>          /* standard input output                    */
+#include <stdlib.h>         /* standard library                         */
+#include <string.h>         /* string functions                         */
+#include <stdint.h>         /* fixed width integers                     */
+#include <unistd.h>         /* miscellaneous functions                  */
+#include <errno.h>          /* error numbers                            */
+#include <fcntl.h>          /* for fcntl                                */
+#include <poll.h>           /* for poll                                 */
+#include <syslog.h>         /* syslog                                   */
+#include <sys/socket.h>     /* socket handling                          */
+#include <sys/sendfile.h>   /* for sendfile                             */
+#include <arpa/inet.h>      /* for sockaddr_in, including <netinet/in.h> */
+#include <netinet/tcp.h>    /* for TCP_NODELAY                          */
+
+/* Own headers */
+#include "config.h"         /* config header                            */
+#include "response.h"       /* response header                          */
+#include "ratelimit.h"      /* rate limit header                        */
+#include "hpack.h"          /* hpack header                             */
+#include "iopool.h"         /* I/O pool header                          */
+#include "arena.h"          /* arena header                             */
+#include "trace.h"          /* trace header                             */
+#include "http2.h"          /* own header                               */
+
+#define BUFFSIZE 1024
+#define true 1
+#define false 0
+
+#define H2_FRAMESIZE 16384                                  /* SETTINGS_MAX_FRAME_SIZE          */
+#define H2_HEADERSIZE 9                                     /* frame header                     */
+#define H2_INSIZE (2 * (H2_FRAMESIZE + H2_HEADERSIZE))      /* input buffer                     */
+#define H2_BLOCKSIZE (4 * H2_FRAMESIZE)                     /* header block with continuations  */
+#define H2_MAXSTREAMS 32                                    /* SETTINGS_MAX_CONCURRENT_STREAMS  */
+#define H2_WINDOW 65535                                     /* initial flow control window      */
+#define H2_MAXWINDOW 0x7fffffff                             /* largest flow control window      */
+#define H2_TIMEOUT 30000                                    /* idle connection timeout in ms    */
+#define H2_TRIMTIME 1000                                    /* idle ms before the slabs are freed */
+#define H2_NAMESIZE 256                                     /* client name in the access log    */
+
+/* Frame types */
+#define H2_DATA 0x0
+#define H2_HEADERS 0x1
+#define H2_PRIORITY 0x2
+#define H2_RST_STREAM 0x3
+#define H2_SETTINGS 0x4
+#define H2_PUSH_PROMISE 0x5
+#define H2_PING 0x6
+#define H2_GOAWAY 0x7
+#define H2_WINDOW_UPDATE 0x8
+#define H2_CONTINUATION 0x9
+
+/* Frame flags */
+#define H2_FLAG_END_STREAM 0x1
+#define H2_FLAG_ACK 0x1
+#define H2_FLAG_END_HEADERS 0x4
+#define H2_FLAG_PADDED 0x8
+#define H2_FLAG_PRIORITY 0x20
+
+/* Settings */
+#define H2_SETTINGS_MAX_CONCURRENT_STREAMS 0x3
+#define H2_SETTINGS_INITIAL_WINDOW_SIZE 0x4
+#define H2_SETTINGS_MAX_FRAME_SIZE 0x5
+
+/* Error codes */
+#define H2_NO_ERROR 0x0
+#define H2_PROTOCOL_ERROR 0x1
+#define H2_INTERNAL_ERROR 0x2
+#define H2_FLOW_CONTROL_ERROR 0x3
+#define H2_STREAM_CLOSED 0x5
+#define H2_FRAME_SIZE_ERROR 0x6
+#define H2_REFUSED_STREAM 0x7
+#define H2_COMPRESSION_ERROR 0x9
+
+typedef struct h2_stream {
+    uint32_t id;                /* stream identifier, 0 once closed     */
+    char method[8];             /* :method                              */
+    char path[PATHSIZE];        /* :path                                */
+    char *body;                 /* request body, the cgi params, kept on reuse */
+    int body_len;               /* length of the request body           */
+    int64_t window;             /* send flow control window             */
+    int responding;             /* request received, response is open   */
+    int loading;                /* body is being opened on the I/O pool */
+    int headers_sent;           /* response HEADERS frame is sent       */
+    int head;                   /* response without body                */
+    int readable;               /* poll reported the cgi pipe           */
+    int status_code;            /* response status code                 */
+    content cont;               /* response body                        */
+    trace tr;                   /* stage timings, logged on close       */
+    struct h2_stream *next;     /* spare list of closed streams         */
+} h2_stream;
+
+typedef struct {
+    const config *conf;                     /* server config                    */
+    int connection;                         /* client connection socket         */
+    struct sockaddr_in *client_addr;        /* client address                   */
+    char client_name[H2_NAMESIZE];          /* resolved once for the access log */
+    uint8_t *in;                            /* received, unprocessed bytes, a slab while not empty */
+    size_t in_len;
+    int preface;                            /* client preface is expected       */
+    uint8_t *block;                         /* header block continued in CONTINUATION frames */
+    size_t block_len;
+    uint32_t block_stream;                  /* stream of the block, 0 if none   */
+    int block_end_stream;                   /* the block ends the stream        */
+    hpack_table decoder;                    /* hpack decoder state              */
+    h2_stream *streams[H2_MAXSTREAMS];      /* open streams, NULL for a free slot */
+    arena mem;                              /* streams and bodies, reset when none is open */
+    h2_stream *spare;                       /* closed streams, reused until the reset */
+    h2_stream *decoding;                    /* target of the decoded headers    */
+    int active;                             /* number of open streams           */
+    int loading;                            /* jobs on the I/O pool             */
+    uint32_t last_stream;                   /* highest client stream id         */
+    int64_t window;                         /* connection send window           */
+    int64_t initial_window;                 /* peer SETTINGS_INITIAL_WINDOW_SIZE */
+    int goaway;                             /* no new streams, close when idle  */
+    int trimmed;                            /* cached slabs freed, no stream since */
+    size_t idle_bytes;                      /* largest footprint while idle     */
+} h2_conn;
+
+/* Opening the body of a response on the I/O pool */
+typedef struct {
+    io_job job;                 /* first member, the pool hands it back */
+    const config *conf;         /* server config                        */
+    uint32_t sid;               /* stream of the response               */
+    char path[PATHSIZE];        /* route to open                        */
+    int status_code;            /* 0 opens the route, else error page   */
+    content cont;               /* opened body                          */
+} h2_open;
+
+/* Reverse lookup of the client for the access log on the I/O pool */
+typedef struct {
+    io_job job;                 /* first member, the pool hands it back */
+    struct sockaddr_in addr;    /* client address                       */
+    char name[H2_NAMESIZE];     /* resolved name                        */
+} h2_resolve;
+
+/* input functions */
+int h2_process_input(h2_conn *h2);
+int h2_handle_frame(h2_conn *h2, int type, int flags, uint32_t sid, const uint8_t *payload, uint32_t len);
+int h2_handle_headers(h2_conn *h2, const uint8_t *block, size_t len);
+int h2_apply_settings(h2_conn *h2, const uint8_t *payload, uint32_t len);
+void h2_header_callback(void *arg, const char *name, size_t name_len, const char *value, size_t value_len);
+
+/* stream functions */
+h2_stream * h2_find_stream(h2_conn *h2, uint32_t sid);
+h2_stream * h2_new_stream(h2_conn *h2, uint32_t sid);
+void h2_close_stream(h2_conn *h2, h2_stream *stream);
+void h2_release_idle(h2_conn *h2);
+void h2_trim_idle(h2_conn *h2);
+void h2_dispatch(h2_conn *h2, h2_stream *stream, int rate_limit);
+void h2_open_run(io_job *job);
+void h2_resolve_run(io_job *job);
+void h2_collect(h2_conn *h2);
+
+/* output functions */
+int h2_send_round(h2_conn *h2, int *pending);
+int h2_send_headers(h2_conn *h2, h2_stream *stream);
+int h2_send_frame(h2_conn *h2, int type, int flags, uint32_t sid, const void *payload, uint32_t len);
+int h2_send_goaway(h2_conn *h2, uint32_t error);
+int h2_send_rst(h2_conn *h2, uint32_t sid, uint32_t error);
+int h2_send_window_update(h2_conn *h2, uint32_t sid, uint32_t increment);
+int send_all(int connection, const void *buffer, size_t len, int flags);
+
+/* misc functions */
+int base64url_decode(const char *in, uint8_t *out, int size);
+
+
+int http2_response(const config *conf, int connection, struct sockaddr_in *client_addr,
+    arena *mem, const char *input, int input_len, const h2_upgrade *upgrade)
+{
+    static const char switching[] =
+        "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+    uint8_t settings[6];
+    uint8_t upgrade_settings[BUFFSIZE];
+    int upgrade_len;
+    h2_conn *h2;
+    h2_stream *stream;
+    h2_resolve *lookup;
+    struct pollfd pfd[2 + H2_MAXSTREAMS];
+    h2_stream *piped[H2_MAXSTREAMS];    /* streams of the polled cgi pipes */
+    int npfd;
+    iopool_stats stats;
+    slab_stats slabs;
+    int pending = 0;
+    int trim;
+    int nodelay = 1;
+    int ready;
+    int rcvd;
+    int i;
+
+    if (input_len > H2_INSIZE)
+    {
+        return EXIT_FAILURE;
+    }
+
+    /* Only the connection state is held for the whole connection, buffers come and go */
+    h2 = calloc(1, sizeof(h2_conn));
+    if (h2 == NULL || (h2->in = slab_alloc(H2_INSIZE)) == NULL)
+    {
+        syslog(LOG_ERR, "HTTP/2 connection allocation failed!");
+        free(h2);
+        return EXIT_FAILURE;
+    }
+    h2->conf = conf;
+    h2->connection = connection;
+    h2->client_addr = client_addr;
+    h2->preface = true;
+    h2->window = H2_WINDOW;
+    h2->initial_window = H2_WINDOW;
+    hpack_init(&h2->decoder);
+    arena_init(&h2->mem);
+
+    memcpy(h2->in, input, input_len);
+    h2->in_len = input_len;
+
+    /* Every stream logs this name, the numeric address until the lookup below is done */
+    inet_ntop(AF_INET, &client_addr->sin_addr, h2->client_name, H2_NAMESIZE);
+
+    /* Frames are coalesced with MSG_MORE, small ones must not wait for Nagle */
+    setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    /* Blocking file system and lookup work runs on threads, one stall must not hold every stream */
+    if ( (iopool_init(conf->io_threads, conf->io_queue)) != EXIT_SUCCESS)
+    {
+        slab_free(h2->in);
+        free(h2);
+        return EXIT_FAILURE;
+    }
+
+    /* The reverse lookup can take seconds, it must not hold the connection either */
+    if (conf->dns && (lookup = slab_alloc(sizeof(h2_resolve))) != NULL)
+    {
+        memset(lookup, 0, sizeof(h2_resolve));
+        lookup->job.run = h2_resolve_run;
+        lookup->addr = *client_addr;
+        ++h2->loading;
+        iopool_submit(&lookup->job);
+    }
+
+    if (upgrade != NULL)
+    {
+        send_all(connection, switching, sizeof(switching) - 1, 0);
+
+        /* The HTTP2-Settings header is the payload of the client SETTINGS */
+        upgrade_len = base64url_decode(upgrade->settings, upgrade_settings, BUFFSIZE);
+        if (upgrade_len < 0 || upgrade_len % 6 != 0 ||
+            (h2_apply_settings(h2, upgrade_settings, upgrade_len)) != EXIT_SUCCESS)
+        {
+            h2_send_goaway(h2, H2_PROTOCOL_ERROR);
+            goto done;
+        }
+    }
+
+    /* Server preface */
+    settings[0] = 0;
+    settings[1] = H2_SETTINGS_MAX_CONCURRENT_STREAMS;
+    settings[2] = 0;
+    settings[3] = 0;
+    settings[4] = 0;
+    settings[5] = H2_MAXSTREAMS;
+    h2_send_frame(h2, H2_SETTINGS, 0, 0, settings, sizeof(settings));
+
+    /* The upgraded request is stream 1, half closed by the client */
+    if (upgrade != NULL)
+    {
+        if ( (stream = h2_new_stream(h2, 1)) == NULL)
+        {
+            h2_send_goaway(h2, H2_INTERNAL_ERROR);
+            goto done;
+        }
+        strncpy(stream->method, upgrade->head ? "HEAD" : "GET", sizeof(stream->method) - 1);
+        strncpy(stream->path, upgrade->route, PATHSIZE - 1);
+        h2->last_stream = 1;
+        h2_dispatch(h2, stream, false);
+    }
+
+    /* Everything is copied, the HTTP/1 request buffers are not held while the connection lives */
+    arena_reset(mem);
+
+    /* The main loop of the connection */
+    while (1)
+    {
+        if ( (h2_process_input(h2)) != EXIT_SUCCESS)
+        {
+            break;
+        }
+
+        if ( (h2_send_round(h2, &pending)) != EXIT_SUCCESS)
+        {
+            break;
+        }
+
+        if (h2->goaway && h2->active == 0)
+        {
+            break;
+        }
+
+        if (h2->active > 0)
+        {
+            h2->trimmed = false;
+        }
+        else if (!pending)
+        {
+            h2_release_idle(h2);
+        }
+
+        /* Only peek at the input and the completions while there are frames to send */
+        pfd[0].fd = connection;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = iopool_fd();
+        pfd[1].events = POLLIN;
+        npfd = 2;
+
+        /* CGI output is read when it arrives, a slow script must not hold the other streams */
+        for (i = 0; i < H2_MAXSTREAMS; ++i)
+        {
+            stream = h2->streams[i];
+            if (stream != NULL && stream->cont.pipe != NULL && !stream->readable &&
+                h2->window > 0 && stream->window > 0)
+            {
+                piped[npfd - 2] = stream;
+                pfd[npfd].fd = stream->cont.fd;
+                pfd[npfd].events = POLLIN;
+                ++npfd;
+            }
+        }
+
+        /* The cached slabs serve the next requests, they are freed once the client pauses */
+        trim = (h2->active == 0 && h2->loading == 0 && !h2->trimmed);
+        ready = poll(pfd, npfd, pending ? 0 : (trim ? H2_TRIMTIME : H2_TIMEOUT));
+        if (ready < 0 && errno != EINTR)
+        {
+            break;
+        }
+        for (i = 2; i < npfd && ready > 0; ++i)
+        {
+            if (pfd[i].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                piped[i - 2]->readable = true;
+            }
+        }
+        if (ready == 0 && trim)
+        {
+            h2_trim_idle(h2);
+            continue;
+        }
+        if (ready == 0 && !pending && h2->loading == 0)
+        {
+            h2_send_goaway(h2, H2_NO_ERROR);    /* Idle connection */
+            break;
+        }
+        if (ready <= 0)
+        {
+            continue;
+        }
+
+        if (pfd[1].revents & POLLIN)
+        {
+            h2_collect(h2);
+        }
+
+        if (pfd[0].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            if (h2->in == NULL && (h2->in = slab_alloc(H2_INSIZE)) == NULL)
+            {
+                syslog(LOG_ERR, "HTTP/2 input buffer allocation failed!");
+                break;
+            }
+            rcvd = recv(connection, h2->in + h2->in_len, H2_INSIZE - h2->in_len, 0);
+            if (rcvd <= 0)
+            {
+                break;  /* Client closed the connection */
+            }
+            h2->in_len += rcvd;
+        }
+    } /* end while */
+
+done:
+    /* Wait for the queued jobs, the bodies they opened are closed with the streams */
+    iopool_shutdown();
+    h2_collect(h2);
+    for (i = 0; i < H2_MAXSTREAMS; ++i)
+    {
+        if (h2->streams[i] != NULL)
+        {
+            close_content(&h2->streams[i]->cont);
+        }
+    }
+
+    iopool_get_stats(&stats);
+    if (stats.jobs > 0)
+    {
+        syslog(LOG_INFO, "I/O pool: %llu jobs (%llu inline), queue depth max %d, "
+            "wait avg %llu us max %llu us, run avg %llu us max %llu us",
+            (unsigned long long) stats.jobs, (unsigned long long) stats.inline_jobs, stats.max_depth,
+            (unsigned long long) (stats.wait_ns / stats.jobs / 1000),
+            (unsigned long long) (stats.max_wait_ns / 1000),
+            (unsigned long long) (stats.run_ns / stats.jobs / 1000),
+            (unsigned long long) (stats.max_run_ns / 1000));
+    }
+    slab_get_stats(&slabs);
+    if (h2->idle_bytes > 0)
+    {
+        syslog(LOG_INFO, "Memory: %zu bytes per idle connection, %zu bytes at peak, %lu slabs reused",
+            h2->idle_bytes, sizeof(h2_conn) + slabs.peak, slabs.reused);
+    }
+    else
+    {
+        syslog(LOG_INFO, "Memory: %zu bytes at peak, %lu slabs reused",
+            sizeof(h2_conn) + slabs.peak, slabs.reused);
+    }
+
+    arena_reset(&h2->mem);
+    slab_free(h2->in);
+    slab_free(h2->block);
+    hpack_free(&h2->decoder);
+    free(h2);
+
+    return EXIT_SUCCESS;
+}
+
+
+/* input functions */
+int h2_process_input(h2_conn *h2)
+{
+    size_t pos = 0;
+    uint32_t len;
+    uint32_t sid;
+    int type;
+    int flags;
+
+    if (h2->in == NULL)
+    {
+        return EXIT_SUCCESS;    /* Nothing received since the last frames */
+    }
+
+    if (h2->preface)
+    {
+        if (h2->in_len < H2_PREFACE_LEN)
+        {
+            return memcmp(h2->in, H2_PREFACE, h2->in_len) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        if (memcmp(h2->in, H2_PREFACE, H2_PREFACE_LEN) != 0)
+        {
+            h2_send_goaway(h2, H2_PROTOCOL_ERROR);
+            return EXIT_FAILURE;
+        }
+        pos = H2_PREFACE_LEN;
+        h2->preface = false;
+    }
+
+    /* Handle every complete frame */
+    while (h2->in_len - pos >= H2_HEADERSIZE)
+    {
+        len = (h2->in[pos] << 16) | (h2->in[pos + 1] << 8) | h2->in[pos + 2];
+        type = h2->in[pos + 3];
+        flags = h2->in[pos + 4];
+        sid = ((uint32_t) (h2->in[pos + 5] & 0x7f) << 24) | (h2->in[pos + 6] << 16) |
+              (h2->in[pos + 7] << 8) | h2->in[pos + 8];
+
+        if (len > H2_FRAMESIZE)
+        {
+            h2_send_goaway(h2, H2_FRAME_SIZE_ERROR);
+            return EXIT_FAILURE;
+        }
+        if (h2->in_len - pos - H2_HEADERSIZE < len)
+        {
+            break;  /* Wait for the rest of the frame */
+        }
+
+        /* A header block can only be continued */
+        if (h2->block_stream != 0 && type != H2_CONTINUATION)
+        {
+            h2_send_goaway(h2, H2_PROTOCOL_ERROR);
+            return EXIT_FAILURE;
+        }
+
+        if ( (h2_handle_frame(h2, type, flags, sid, h2->in + pos + H2_HEADERSIZE, len)) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+        pos += H2_HEADERSIZE + len;
+    } /* end while */
+
+    memmove(h2->in, h2->in + pos, h2->in_len - pos);
+    h2->in_len -= pos;
+
+    /* No partial frame, the buffer goes back to the pool until the next recv */
+    if (h2->in_len == 0)
+    {
+        slab_free(h2->in);
+        h2->in = NULL;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Connection errors send GOAWAY and return EXIT_FAILURE, stream errors only reset the stream */
+int h2_handle_frame(h2_conn *h2, int type, int flags, uint32_t sid, const uint8_t *payload, uint32_t len)
+{
+    h2_stream *stream;
+    uint32_t increment;
+    uint32_t pad = 0;
+    uint32_t n;
+    int result;
+
+    switch (type)
+    {
+        case H2_DATA:
+            if (sid == 0)
+            {
+                h2_send_goaway(h2, H2_PROTOCOL_ERROR);
+                return EXIT_FAILURE;
+            }
+            if (flags & H2_FLAG_PADDED)
+            {
+                if (len == 0 || (pad = payload[0]) >= len)
+                {
+                    h2_send_goaway(h2, H2_PROTOCOL_ERROR);
+                    return EXIT_FAILURE;
+                }
+                ++payload;
+                len -= pad + 1;
+                pad += 1;
+            }
+
+            /* The connection window is given back for every frame */
+            if (len + pad > 0)
+            {
+                h2_send_window_update(h2, 0, len + pad);
+            }
+
+            stream = h2_find_stream(h2, sid);
+            if (stream == NULL || stream->responding)
+            {
+                h2_send_rst(h2, sid, H2_STREAM_CLOSED);
+                break;
+            }
+            if (len + pad > 0 && !(flags & H2_FLAG_END_STREAM))
+            {
+                h2_send_window_update(h2, sid, len + pad);
+            }
+
+            /* Only the params are kept, like the HTTP/1 request buffer */
+            if (stream->body == NULL && (stream->body = arena_alloc(&h2->mem, BUFFSIZE)) == NULL)
+            {
+                h2_send_rst(h2, sid, H2_INTERNAL_ERROR);
+                h2_close_stream(h2, stream);
+                break;
+            }
+            n = len;
+            if (n > BUFFSIZE - 1 - stream->body_len)
+            {
+                n = BUFFSIZE - 1 - stream->body_len;
+            }
+            memcpy(stream->body + stream->body_len, payload, n);
+            stream->body_len += n;
+
+            if (flags & H2_FLAG_END_STREAM)
+            {
+                h2_dispatch(h2, stream, true);
+            }
+            break;
+
+        case H2_HEADERS:
+            if (sid == 0)
+            {
+                h2_send_goaway(h2, H2_PROTOCOL_ERROR);
+                return EXIT_FAILURE;
+            }
+            if (flags & H2_FLAG_PADDED)
+            {
+                if (len == 0 || (pad = payload[0]) >= len)
+                {
+                    h2_send_goaway(h2, H2_PROTOCOL_ERROR);
+                    return EXIT_FAILURE;
+                }
+                ++payload;
+                len -= pad + 1;
+            }
+            if (flags & H2_FLAG_PRIORITY)
+            {
+                if (len < 5)
+                {
+                    h2_send_goaway(h2, H2_FRAME_SIZE_ERROR);
+                    return EXIT_FAILURE;
+                }
+                payload += 5;
+                len -= 5;
+            }
+
+            h2->block_stream = sid;
+            h2->block_end_stream = flags & H2_FLAG_END_STREAM;
+
+            /* A complete block is decoded in place, only a continued one is copied */
+            if (flags & H2_FLAG_END_HEADERS)
+            {
+                return h2_handle_headers(h2, payload, len);
+            }
+            if ( (h2->block = slab_alloc(H2_BLOCKSIZE)) == NULL)
+            {
+                h2_send_goaway(h2, H2_INTERNAL_ERROR);
+                return EXIT_FAILURE;
+            }
+            memcpy(h2->block, payload, len);
+            h2->block_len = len;
+            break;
+
+        case H2_CONTINUATION:
+            if (h2->block_stream == 0 || sid != h2->block_stream ||
+                len > H2_BLOCKSIZE - h2->block_len)
+            {
+                h2_send_goaway(h2, H2_PROTOCOL_ERROR);
+                return EXIT_FAILURE;
+            }
+            memcpy(h2->block + h2->block_len, payload, len);
+            h2->block_len += len;
+
+            if (flags & H2_FLAG_END_HEADERS)
+            {
+                result = h2_handle_headers(h2, h2->block, h2->block_len);
+                slab_free(h2->block);
+                h2->block = NULL;
+                return result;
+            }
+            break;
+
+        case H2_PRIORITY:
+            break;  /* Streams are served round robin */
+
+        case H2_RST_STREAM:
+            if (sid == 0 || len != 4)
+            {
+                h2_send_goaway(h2, sid == 0 ? H2_PROTOCOL_ERROR : H2_FRAME_SIZE_ERROR);
+                return EXIT_FAILURE;
+            }
+            if ( (stream = h2_find_stream(h2, sid)) != NULL)
+            {
+                h2_close_stream(h2, stream);
+            }
+            break;
+
+        case H2_SETTINGS:
+            if (sid != 0)
+            {
+                h2_send_goaway(h2, H2_PROTOCOL_ERROR);
+                return EXIT_FAILURE;
+            }
+            if (flags & H2_FLAG_ACK)
+            {
+                if (len != 0)
+                {
+                    h2_send_goaway(h2, H2_FRAME_SIZE_ERROR);
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            if (len % 6 != 0)
+            {
+                h2_send_goaway(h2, H2_FRAME_SIZE_ERROR);
+                return EXIT_FAILURE;
+            }
+            if ( (h2_apply_settings(h2, payload, len)) != EXIT_SUCCESS)
+            {
+                return EXIT_FAILURE;
+            }
+            h2_send_frame(h2, H2_SETTINGS, H2_FLAG_ACK, 0, NULL, 0);
+            break;
+
+        case H2_PUSH_PROMISE:
+            h2_send_goaway(h2, H2_PROTOCOL_ERROR);    /* Clients can not push */
+            return EXIT_FAILURE;
+
+        case H2_PING:
+            if (sid != 0 || len != 8)
+            {
+                h2_send_goaway(h2, sid != 0 ? H2_PROTOCOL_ERROR : H2_FRAME_SIZE_ERROR);
+                return EXIT_FAILURE;
+            }
+            if (!(flags & H2_FLAG_ACK))
+            {
+                h2_send_frame(h2, H2_PING, H2_FLAG_ACK, 0, payload, len);
+            }
+            break;
+
+        case H2_GOAWAY:
+            h2->goaway = true;  /* Finish the open streams */
+            break;
+
+        case H2_WINDOW_UPDATE:
+            if (len != 4)
+            {
+                h2_send_goaway(h2, H2_FRAME_SIZE_ERROR);
+                return EXIT_FAILURE;
+            }
+            increment = ((uint32_t) (payload[0] & 0x7f) << 24) | (payload[1] << 16) |
+                        (payload[2] << 8) | payload[3];
+
+            if (sid == 0)
+            {
+                h2->window += increment;
+                if (increment == 0 || h2->window > H2_MAXWINDOW)
+                {
+                    h2_send_goaway(h2, increment == 0 ? H2_PROTOCOL_ERROR : H2_FLOW_CONTROL_ERROR);
+                    return EXIT_FAILURE;
+                }
+            }
+            else if ( (stream = h2_find_stream(h2, sid)) != NULL)
+            {
+                stream->window += increment;
+                if (increment == 0 || stream->window > H2_MAXWINDOW)
+                {
+                    h2_send_rst(h2, sid, increment == 0 ? H2_PROTOCOL_ERROR : H2_FLOW_CONTROL_ERROR);
+                    h2_close_stream(h2, stream);
+                }
+            }
+            break;
+
+        default:
+            break;  /* Unknown frame types are ignored */
+    } /* end switch */
+
+    return EXIT_SUCCESS;
+}
+
+int h2_handle_headers(h2_conn *h2, const uint8_t *block, size_t len)
+{
+    uint32_t sid = h2->block_stream;
+    h2_stream *stream;
+
+    h2->block_stream = 0;
+
+    stream = h2_find_stream(h2, sid);
+    if (stream == NULL)
+    {
+        /* New streams are odd and increasing */
+        if (sid % 2 == 0 || sid <= h2->last_stream)
+        {
+            h2_send_goaway(h2, H2_PROTOCOL_ERROR);
+            return EXIT_FAILURE;
+        }
+        h2->last_stream = sid;
+        if (!h2->goaway && h2->active < H2_MAXSTREAMS)
+        {
+            stream = h2_new_stream(h2, sid);
+        }
+    }
+    else if (stream->responding)
+    {
+        stream = NULL;  /* Headers after the end of the stream */
+    }
+
+    /* Every block is decoded, the dynamic table has to stay in sync */
+    h2->decoding = stream;
+    if (stream != NULL)
+    {
+        trace_start(&stream->tr, TRACE_PARSE);
+    }
+    if ( (hpack_decode(&h2->decoder, block, len, h2_header_callback, h2)) != EXIT_SUCCESS)
+    {
+        h2_send_goaway(h2, H2_COMPRESSION_ERROR);
+        return EXIT_FAILURE;
+    }
+    if (stream != NULL)
+    {
+        trace_end(&stream->tr, TRACE_PARSE);
+    }
+    h2->decoding = NULL;
+
+    if (stream == NULL)
+    {
+        h2_send_rst(h2, sid, h2_find_stream(h2, sid) != NULL ? H2_STREAM_CLOSED : H2_REFUSED_STREAM);
+        return EXIT_SUCCESS;
+    }
+
+    if (h2->block_end_stream)
+    {
+        h2_dispatch(h2, stream, true);
+    }
+    return EXIT_SUCCESS;
+}
+
+int h2_apply_settings(h2_conn *h2, const uint8_t *payload, uint32_t len)
+{
+    uint32_t id;
+    uint32_t value;
+    uint32_t i;
+    int j;
+
+    for (i = 0; i + 6 <= len; i += 6)
+    {
+        id = (payload[i] << 8) | payload[i + 1];
+        value = ((uint32_t) payload[i + 2] << 24) | (payload[i + 3] << 16) |
+                (payload[i + 4] << 8) | payload[i + 5];
+
+        switch (id)
+        {
+            case H2_SETTINGS_INITIAL_WINDOW_SIZE:
+                if (value > H2_MAXWINDOW)
+                {
+                    h2_send_goaway(h2, H2_FLOW_CONTROL_ERROR);
+                    return EXIT_FAILURE;
+                }
+                /* Applies to the open streams too */
+                for (j = 0; j < H2_MAXSTREAMS; ++j)
+                {
+                    if (h2->streams[j] != NULL)
+                    {
+                        h2->streams[j]->window += (int64_t) value - h2->initial_window;
+                    }
+                }
+                h2->initial_window = value;
+                break;
+            case H2_SETTINGS_MAX_FRAME_SIZE:
+                /* DATA frames are never larger than the minimum anyway */
+                if (value < H2_FRAMESIZE || value > 0xffffff)
+                {
+                    h2_send_goaway(h2, H2_PROTOCOL_ERROR);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                break;  /* The encoder uses no dynamic table, push is never used */
+        } /* end switch */
+    } /* end for */
+
+    return EXIT_SUCCESS;
+}
+
+void h2_header_callback(void *arg, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+    h2_stream *stream = ((h2_conn *) arg)->decoding;
+
+    if (stream == NULL)
+    {
+        return;
+    }
+
+    if (name_len == 7 && memcmp(name, ":method", 7) == 0 && value_len < sizeof(stream->method))
+    {
+        memcpy(stream->method, value, value_len);
+        stream->method[value_len] = '\0';
+    }
+    else if (name_len == 5 && memcmp(name, ":path", 5) == 0 && value_len < PATHSIZE)
+    {
+        memcpy(stream->path, value, value_len);
+        stream->path[value_len] = '\0';
+    }
+}
+
+
+/* stream functions */
+h2_stream * h2_find_stream(h2_conn *h2, uint32_t sid)
+{
+    int i;
+
+    for (i = 0; i < H2_MAXSTREAMS; ++i)
+    {
+        if (h2->streams[i] != NULL && h2->streams[i]->id == sid)
+        {
+            return h2->streams[i];
+        }
+    }
+    return NULL;
+}
+
+/* NULL if the arena is out of memory, the stream is refused */
+h2_stream * h2_new_stream(h2_conn *h2, uint32_t sid)
+{
+    h2_stream *stream;
+    char *body;
+    int i;
+
+    /* Closed streams are reused until the arena is reset */
+    if ( (stream = h2->spare) != NULL)
+    {
+        h2->spare = stream->next;
+    }
+    else if ( (stream = arena_alloc(&h2->mem, sizeof(h2_stream))) == NULL)
+    {
+        return NULL;
+    }
+
+    body = stream->body;
+    memset(stream, 0, sizeof(h2_stream));
+    stream->body = body;
+    stream->id = sid;
+    stream->window = h2->initial_window;
+    stream->cont.fd = -1;
+    trace_begin(&stream->tr);
+
+    for (i = 0; i < H2_MAXSTREAMS; ++i)
+    {
+        if (h2->streams[i] == NULL)
+        {
+            h2->streams[i] = stream;
+            break;
+        }
+    }
+    ++h2->active;
+    return stream;
+}
+
+/* The memory stays valid until the arena reset, callers may still look at the id */
+void h2_close_stream(h2_conn *h2, h2_stream *stream)
+{
+    int i;
+
+    /* Access log once the response is over, streams reset before it are not logged */
+    if (stream->status_code != 0)
+    {
+        log_named_response(stream->status_code, stream->method, stream->path,
+            h2->client_name, &stream->tr);
+    }
+
+    close_content(&stream->cont);
+    for (i = 0; i < H2_MAXSTREAMS; ++i)
+    {
+        if (h2->streams[i] == stream)
+        {
+            h2->streams[i] = NULL;
+        }
+    }
+    stream->id = 0;
+    stream->next = h2->spare;
+    h2->spare = stream;
+    --h2->active;
+}
+
+/* Every request is answered, drop the request state, its slabs stay cached for the next requests */
+void h2_release_idle(h2_conn *h2)
+{
+    h2->spare = NULL;
+    arena_reset(&h2->mem);
+}
+
+/* No request for H2_TRIMTIME, free the cached slabs and measure what is left */
+void h2_trim_idle(h2_conn *h2)
+{
+    slab_stats slabs;
+    size_t bytes;
+
+    slab_trim();
+    h2->trimmed = true;
+
+    /* The connection itself, a partial frame and the dynamic table strings */
+    slab_get_stats(&slabs);
+    bytes = sizeof(h2_conn) + slabs.in_use + h2->decoder.size;
+    if (bytes > h2->idle_bytes)
+    {
+        h2->idle_bytes = bytes;
+    }
+}
+
+/* Open the response of a complete request, same routes as the HTTP/1 response */
+void h2_dispatch(h2_conn *h2, h2_stream *stream, int rate_limit)
+{
+    const config *conf = h2->conf;
+    h2_open *op;
+    char *params;
+    int status_code = 0;
+    int opened;
+
+    stream->responding = true;
+    stream->head = (strcmp(stream->method, "HEAD") == 0);
+
+    /* From the HEADERS to the end of the stream, the DATA of a POST */
+    stream->tr.ns[TRACE_RECV] = trace_elapsed(&stream->tr) - stream->tr.ns[TRACE_PARSE];
+
+    /* Params of a GET request are not used */
+    if ( (params = strchr(stream->path, '?')) != NULL)
+    {
+        *params = '\0';
+    }
+    /* for GET and HEAD request to "/" route give the "/index.html" */
+    if (strcmp(stream->path, "/") == 0)
+    {
+        strncpy(stream->path, "/index.html", PATHSIZE);
+    }
+
+    if (rate_limit && (status_code = rl_request(h2->client_addr, stream->path)) != 0)
+    {
+        /* Rejected, answered with the error page */
+    }
+    else if (strcmp(stream->method, "GET") == 0 || stream->head)
+    {
+        status_code = 0; /* Opened on the I/O pool */
+    }
+    else if (strcmp(stream->method, "POST") == 0 && strncmp(stream->path, "/cgi/", 5) == 0)
+    {
+        if (stream->body == NULL)
+        {
+            stream->body = arena_alloc(&h2->mem, BUFFSIZE);  /* POST without DATA */
+        }
+        if (stream->body != NULL)
+        {
+            stream->body[stream->body_len] = '\0';
+            trace_start(&stream->tr, TRACE_CGI);
+            opened = open_cgi_content(conf, stream->path + 5, stream->body, &stream->cont);
+            trace_end(&stream->tr, TRACE_CGI);
+            if (opened == EXIT_SUCCESS)
+            {
+                /* Read when poll reports output, see h2_send_round */
+                fcntl(stream->cont.fd, F_SETFL, fcntl(stream->cont.fd, F_GETFL) | O_NONBLOCK);
+                stream->status_code = 200; /* OK */
+                return;
+            }
+        }
+        status_code = 500; /* Internal server error */
+    }
+    else
+    {
+        status_code = 400; /* Bad request */
+    }
+
+    /* Static files and error pages are opened on the I/O pool */
+    op = slab_alloc(sizeof(h2_open));
+    if (op == NULL)
+    {
+        stream->status_code = 500; /* Internal server error, without body */
+        return;
+    }
+    memset(op, 0, sizeof(h2_open));
+    op->job.run = h2_open_run;
+    op->conf = h2->conf;
+    op->sid = stream->id;
+    strncpy(op->path, stream->path, PATHSIZE - 1);
+    op->status_code = status_code;
+    op->cont.fd = -1;
+
+    stream->loading = true;
+    ++h2->loading;
+    iopool_submit(&op->job);
+}
+
+/* Runs on a pool thread, touches only the job */
+void h2_open_run(io_job *job)
+{
+    h2_open *op = (h2_open *) job;
+
+    if (op->status_code == 0)
+    {
+        if ( (open_content(op->conf, op->path, &op->cont)) == EXIT_SUCCESS)
+        {
+            op->status_code = 200; /* OK */
+            prefetch_content(&op->cont);
+            return;
+        }
+        op->status_code = 404; /* Not found */
+    }
+
+    open_error_content(op->conf, op->status_code, &op->cont);
+}
+
+/* Runs on a pool thread, the only caller of resolve_addr while the connection lives */
+void h2_resolve_run(io_job *job)
+{
+    h2_resolve *lookup = (h2_resolve *) job;
+
+    snprintf(lookup->name, H2_NAMESIZE, "%s", resolve_addr(&lookup->addr, true));
+}
+
+/* Hand the opened bodies to their streams, bodies of reset streams are closed */
+void h2_collect(h2_conn *h2)
+{
+    h2_stream *stream;
+    h2_open *op;
+    io_job *job;
+
+    while ( (job = iopool_complete()) != NULL)
+    {
+        --h2->loading;
+
+        /* The client name, the streams closed from now on log it */
+        if (job->run == h2_resolve_run)
+        {
+            memcpy(h2->client_name, ((h2_resolve *) job)->name, H2_NAMESIZE);
+            slab_free(job);
+            continue;
+        }
+
+        op = (h2_open *) job;
+
+        stream = h2_find_stream(h2, op->sid);
+        if (stream == NULL || !stream->loading)
+        {
+            close_content(&op->cont);
+            slab_free(op);
+            continue;
+        }
+
+        stream->cont = op->cont;
+        stream->status_code = op->status_code;
+        stream->loading = false;
+        trace_span(&stream->tr, TRACE_QUEUE, &job->queued, &job->started);
+        trace_span(&stream->tr, TRACE_OPEN, &job->started, &job->finished);
+        slab_free(op);
+    } /* end while */
+}
+
+
+/* output functions */
+
+/* One HEADERS or DATA frame for every stream that can send, round robin */
+int h2_send_round(h2_conn *h2, int *pending)
+{
+    h2_stream *stream;
+    uint8_t header[H2_HEADERSIZE];
+    uint8_t *out;
+    int64_t chunk;
+    ssize_t sent;
+    int result;
+    int last;
+    int i;
+
+    *pending = false;
+
+    /* After an upgrade wait for the client preface, clients buffer little before it */
+    if (h2->preface)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    for (i = 0; i < H2_MAXSTREAMS; ++i)
+    {
+        stream = h2->streams[i];
+        if (stream == NULL || !stream->responding || stream->loading)
+        {
+            continue;
+        }
+
+        /* Only this stream's frames, a closed stream ends it with its trace */
+        trace_start(&stream->tr, TRACE_SEND);
+
+        if (!stream->headers_sent)
+        {
+            if ( (h2_send_headers(h2, stream)) != EXIT_SUCCESS)
+            {
+                return EXIT_FAILURE;
+            }
+            if (stream->id == 0)
+            {
+                continue;   /* Finished without body */
+            }
+        }
+
+        /* DATA frames are limited by both flow control windows */
+        chunk = H2_FRAMESIZE;
+        if (chunk > h2->window)
+        {
+            chunk = h2->window;
+        }
+        if (chunk > stream->window)
+        {
+            chunk = stream->window;
+        }
+        if (stream->cont.size >= 0 && chunk > stream->cont.size)
+        {
+            chunk = stream->cont.size;
+        }
+        if (chunk <= 0 && stream->cont.size != 0)
+        {
+            trace_end(&stream->tr, TRACE_SEND);
+            continue;   /* Blocked until a WINDOW_UPDATE */
+        }
+
+        if (stream->cont.pipe != NULL)
+        {
+            /* CGI output once poll reported the pipe, the end of the output ends the stream */
+            if (!stream->readable)
+            {
+                trace_end(&stream->tr, TRACE_SEND);
+                continue;
+            }
+            stream->readable = false;
+
+            if ( (out = slab_alloc(H2_FRAMESIZE)) == NULL)
+            {
+                return EXIT_FAILURE;
+            }
+            sent = read(stream->cont.fd, out, chunk);
+            if (sent < 0 && (errno == EAGAIN || errno == EINTR))
+            {
+                slab_free(out);
+                trace_end(&stream->tr, TRACE_SEND);
+                continue;   /* Nothing yet, polled again */
+            }
+            if (sent < 0)
+            {
+                sent = 0;
+            }
+            last = (sent == 0);
+            result = h2_send_frame(h2, H2_DATA, last ? H2_FLAG_END_STREAM : 0, stream->id, out, sent);
+            slab_free(out);
+            if (result != EXIT_SUCCESS)
+            {
+                return EXIT_FAILURE;
+            }
+            chunk = sent;
+        }
+        else
+        {
+            /* File or pack entry, the frame header is corked with the sendfile payload */
+            last = (chunk == stream->cont.size);
+            header[0] = (chunk >> 16) & 0xff;
+            header[1] = (chunk >> 8) & 0xff;
+            header[2] = chunk & 0xff;
+            header[3] = H2_DATA;
+            header[4] = last ? H2_FLAG_END_STREAM : 0;
+            header[5] = (stream->id >> 24) & 0x7f;
+            header[6] = (stream->id >> 16) & 0xff;
+            header[7] = (stream->id >> 8) & 0xff;
+            header[8] = stream->id & 0xff;
+            if ( (send_all(h2->connection, header, H2_HEADERSIZE, MSG_MORE)) != EXIT_SUCCESS)
+            {
+                return EXIT_FAILURE;
+            }
+            while (chunk > 0)
+            {
+                sent = sendfile(h2->connection, stream->cont.fd, &stream->cont.offset, chunk);
+                if (sent <= 0)
+                {
+                    syslog(LOG_ERR, "Failed send file!: %s", strerror(errno));
+                    return EXIT_FAILURE;
+                }
+                chunk -= sent;
+                stream->cont.size -= sent;
+                h2->window -= sent;
+                stream->window -= sent;
+            }
+        }
+
+        if (stream->cont.pipe != NULL)
+        {
+            h2->window -= chunk;
+            stream->window -= chunk;
+        }
+
+        if (last)
+        {
+            h2_close_stream(h2, stream);
+        }
+        else if (stream->cont.pipe == NULL && h2->window > 0 && stream->window > 0)
+        {
+            *pending = true;    /* A CGI stream waits for poll instead */
+        }
+        trace_end(&stream->tr, TRACE_SEND);
+    } /* end for */
+
+    return EXIT_SUCCESS;
+}
+
+int h2_send_headers(h2_conn *h2, h2_stream *stream)
+{
+    uint8_t block[BUFFSIZE];
+    char length[32];
+    size_t len;
+    int end_stream;
+
+    /* No body for HEAD and for an error without error page */
+    if (stream->cont.fd < 0)
+    {
+        stream->cont.size = 0;
+    }
+    end_stream = stream->head || stream->cont.size == 0;
+
+    len = hpack_encode_status(block, BUFFSIZE, stream->status_code);
+    len += hpack_encode_field(block + len, BUFFSIZE - len, HPACK_CONTENT_TYPE, "text/html");
+    if (stream->cont.size >= 0)
+    {
+        snprintf(length, sizeof(length), "%lld", (long long) stream->cont.size);
+        len += hpack_encode_field(block + len, BUFFSIZE - len, HPACK_CONTENT_LENGTH, length);
+    }
+
+    if ( (h2_send_frame(h2, H2_HEADERS, H2_FLAG_END_HEADERS | (end_stream ? H2_FLAG_END_STREAM : 0),
+            stream->id, block, len)) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    stream->headers_sent = true;
+
+    if (end_stream)
+    {
+        h2_close_stream(h2, stream);
+    }
+    return EXIT_SUCCESS;
+}
+
+int h2_send_frame(h2_conn *h2, int type, int flags, uint32_t sid, const void *payload, uint32_t len)
+{
+    uint8_t header[H2_HEADERSIZE];
+
+    header[0] = (len >> 16) & 0xff;
+    header[1] = (len >> 8) & 0xff;
+    header[2] = len & 0xff;
+    header[3] = type;
+    header[4] = flags;
+    header[5] = (sid >> 24) & 0x7f;
+    header[6] = (sid >> 16) & 0xff;
+    header[7] = (sid >> 8) & 0xff;
+    header[8] = sid & 0xff;
+
+    if ( (send_all(h2->connection, header, H2_HEADERSIZE, len > 0 ? MSG_MORE : 0)) != EXIT_SUCCESS ||
+         (len > 0 && (send_all(h2->connection, payload, len, 0)) != EXIT_SUCCESS))
+    {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int h2_send_goaway(h2_conn *h2, uint32_t error)
+{
+    uint8_t payload[8];
+
+    payload[0] = (h2->last_stream >> 24) & 0x7f;
+    payload[1] = (h2->last_stream >> 16) & 0xff;
+    payload[2] = (h2->last_stream >> 8) & 0xff;
+    payload[3] = h2->last_stream & 0xff;
+    payload[4] = (error >> 24) & 0xff;
+    payload[5] = (error >> 16) & 0xff;
+    payload[6] = (error >> 8) & 0xff;
+    payload[7] = error & 0xff;
+
+    h2->goaway = true;
+    return h2_send_frame(h2, H2_GOAWAY, 0, 0, payload, sizeof(payload));
+}
+
+int h2_send_rst(h2_conn *h2, uint32_t sid, uint32_t error)
+{
+    uint8_t payload[4];
+
+    payload[0] = (error >> 24) & 0xff;
+    payload[1] = (error >> 16) & 0xff;
+    payload[2] = (error >> 8) & 0xff;
+    payload[3] = error & 0xff;
+
+    return h2_send_frame(h2, H2_RST_STREAM, 0, sid, payload, sizeof(payload));
+}
+
+int h2_send_window_update(h2_conn *h2, uint32_t sid, uint32_t increment)
+{
+    uint8_t payload[4];
+
+    payload[0] = (increment >> 24) & 0x7f;
+    payload[1] = (increment >> 16) & 0xff;
+    payload[2] = (increment >> 8) & 0xff;
+    payload[3] = increment & 0xff;
+
+    return h2_send_frame(h2, H2_WINDOW_UPDATE, 0, sid, payload, sizeof(payload));
+}
+
+int send_all(int connection, const void *buffer, size_t len, int flags)
+{
+    const char *p = buffer;
+    ssize_t sent;
+
+    while (len > 0)
+    {
+        sent = send(connection, p, len, flags | MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return EXIT_FAILURE;
+        }
+        p += sent;
+        len -= sent;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/* misc functions */
+int base64url_decode(const char *in, uint8_t *out, int size)
+{
+    uint32_t bits = 0;
+    int nbits = 0;
+    int len = 0;
+    int value;
+
+    for (; *in != '\0' && *in != '='; ++in)
+    {
+        if (*in >= 'A' && *in <= 'Z')
+        {
+            value = *in - 'A';
+        }
+        else if (*in >= 'a' && *in <= 'z')
+        {
+            value = *in - 'a' + 26;
+        }
+        else if (*in >= '0' && *in <= '9')
+        {
+            value = *in - '0' + 52;
+        }
+        else if (*in == '-' || *in == '+')
+        {
+            value = 62;
+        }
+        else if (*in == '_' || *in == '/')
+        {
+            value = 63;
+        }
+        else
+        {
+            return -1;
+        }
+
+        bits = (bits << 6) | value;
+        nbits += 6;
+        if (nbits >= 8)
+        {
+            nbits -= 8;
+            if (len >= size)
+            {
+                return -1;
+            }
+            out[len++] = (bits >> nbits) & 0xff;
+        }
+    } /* end for */
+
+    return len;
+}
@@ -0,0 +1,20 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_PREFACE_LEN 24
+
+/* HTTP/1.1 request upgraded to h2c, answered on stream 1 */
+typedef struct {
+    int head;               /* HEAD request, no body            */
+    const char *route;      /* request route                    */
+    const char *settings;   /* HTTP2-Settings header value      */
+} h2_upgrade;
+
+/* Serve an HTTP/2 connection until it is closed, input is what was already
+ * received: the client preface, or what follows an upgrade request. The request
+ * arena mem is reset once the input is taken over */
+int http2_response(const config *conf, int connection, struct sockaddr_in *client_addr,
+    arena *mem, const char *input, int input_len, const h2_upgrade *upgrade);
+
+#endif
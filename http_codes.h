@@ -12,6 +12,7 @@
 #define HTTP_401 "HTTP/1.0 401 Unauthorized"
 #define HTTP_403 "HTTP/1.0 403 Forbidden"
 #define HTTP_404 "HTTP/1.0 404 Not Found"
+#define HTTP_429 "HTTP/1.0 429 Too Many Requests"
 #define HTTP_500 "HTTP/1.0 500 Internal Server Error"
 #define HTTP_501 "HTTP/1.0 501 Not Implemented"
 #define HTTP_502 "HTTP/1.0 502 Bad Gateway"
@@ -0,0 +1,228 @@
+#include <stdio.h>          /* standard input output                    */
+#include <stdlib.h>         /* standard library                         */
+#include <string.h>         /* string functions                         */
+#include <stdint.h>         /* fixed width integers                     */
+#include <unistd.h>         /* miscellaneous functions                  */
+#include <errno.h>          /* error numbers                            */
+#include <pthread.h>        /* threads                                  */
+#include <syslog.h>         /* syslog                                   */
+#include <sys/eventfd.h>    /* for eventfd                              */
+
+/* Own header */
+#include "iopool.h"         /* iopool header                            */
+
+typedef struct {
+    pthread_t threads[IOPOOL_MAXTHREADS];
+    int nthreads;                   /* running threads                  */
+    pthread_mutex_t lock;           /* protects everything below        */
+    pthread_cond_t cond;            /* signals queued jobs and stop     */
+    io_job **queue;                 /* bounded ring of waiting jobs     */
+    int size;                       /* capacity of the ring             */
+    int head;                       /* next job to run                  */
+    int count;                      /* jobs in the ring                 */
+    io_job *done;                   /* completed jobs, newest first     */
+    int stop;                       /* threads exit when the ring is empty */
+    int efd;                        /* eventfd of the completions       */
+    iopool_stats stats;
+} iopool;
+
+static iopool pool = { .efd = -1 };
+
+void * iopool_thread(void *arg);
+void finish_job(io_job *job);
+uint64_t elapsed_ns(const struct timespec *from, const struct timespec *to);
+
+
+int iopool_init(int threads, int queue_size)
+{
+    int i;
+
+    pool.efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pool.efd < 0)
+    {
+        syslog(LOG_ERR, "I/O pool eventfd failed!: %s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+
+    if (threads <= 0 || queue_size <= 0)
+    {
+        return EXIT_SUCCESS;    /* Jobs run inline, completions still go through the eventfd */
+    }
+
+    pool.queue = calloc(queue_size, sizeof(io_job *));
+    if (pool.queue == NULL)
+    {
+        syslog(LOG_ERR, "I/O pool queue allocation failed!");
+        return EXIT_FAILURE;
+    }
+    pool.size = queue_size;
+
+    if (threads > IOPOOL_MAXTHREADS)
+    {
+        threads = IOPOOL_MAXTHREADS;
+    }
+    for (i = 0; i < threads; ++i)
+    {
+        if (pthread_create(&pool.threads[i], NULL, iopool_thread, NULL) != 0)
+        {
+            syslog(LOG_ERR, "I/O pool thread creation failed!");
+            break;
+        }
+        ++pool.nthreads;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void iopool_shutdown()
+{
+    int i;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.cond);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (i = 0; i < pool.nthreads; ++i)
+    {
+        pthread_join(pool.threads[i], NULL);
+    }
+    pool.nthreads = 0;
+
+    free(pool.queue);
+    pool.queue = NULL;
+    pool.size = 0;
+}
+
+int iopool_fd()
+{
+    return pool.efd;
+}
+
+void iopool_submit(io_job *job)
+{
+    clock_gettime(CLOCK_MONOTONIC, &job->queued);
+
+    pthread_mutex_lock(&pool.lock);
+    if (pool.nthreads > 0 && !pool.stop && pool.count < pool.size)
+    {
+        pool.queue[(pool.head + pool.count) % pool.size] = job;
+        ++pool.count;
+        pool.stats.depth = pool.count;
+        if (pool.count > pool.stats.max_depth)
+        {
+            pool.stats.max_depth = pool.count;
+        }
+        pthread_cond_signal(&pool.cond);
+        pthread_mutex_unlock(&pool.lock);
+        return;
+    }
+    ++pool.stats.inline_jobs;
+    pthread_mutex_unlock(&pool.lock);
+
+    /* Pool is off or full, the caller pays the stall */
+    job->started = job->queued;
+    job->run(job);
+    finish_job(job);
+}
+
+io_job * iopool_complete()
+{
+    io_job *job;
+    uint64_t value;
+
+    pthread_mutex_lock(&pool.lock);
+    job = pool.done;
+    if (job != NULL)
+    {
+        pool.done = job->next;
+    }
+    else
+    {
+        /* Nothing left, reset the eventfd until the next completion */
+        if (read(pool.efd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+        {
+            syslog(LOG_ERR, "I/O pool eventfd read failed!: %s", strerror(errno));
+        }
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    return job;
+}
+
+void iopool_get_stats(iopool_stats *stats)
+{
+    pthread_mutex_lock(&pool.lock);
+    *stats = pool.stats;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+
+void * iopool_thread(void *arg)
+{
+    io_job *job;
+
+    while (1)
+    {
+        pthread_mutex_lock(&pool.lock);
+        while (pool.count == 0 && !pool.stop)
+        {
+            pthread_cond_wait(&pool.cond, &pool.lock);
+        }
+        if (pool.count == 0)
+        {
+            pthread_mutex_unlock(&pool.lock);
+            return NULL;    /* Stopped and drained */
+        }
+        job = pool.queue[pool.head];
+        pool.head = (pool.head + 1) % pool.size;
+        --pool.count;
+        pool.stats.depth = pool.count;
+        pthread_mutex_unlock(&pool.lock);
+
+        clock_gettime(CLOCK_MONOTONIC, &job->started);
+        job->run(job);
+        finish_job(job);
+    } /* end while */
+}
+
+/* Account the job, put it on the completion list and wake the serving loop */
+void finish_job(io_job *job)
+{
+    uint64_t one = 1;
+    uint64_t wait_ns;
+    uint64_t run_ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &job->finished);
+    wait_ns = elapsed_ns(&job->queued, &job->started);
+    run_ns = elapsed_ns(&job->started, &job->finished);
+
+    pthread_mutex_lock(&pool.lock);
+    ++pool.stats.jobs;
+    pool.stats.wait_ns += wait_ns;
+    pool.stats.run_ns += run_ns;
+    if (wait_ns > pool.stats.max_wait_ns)
+    {
+        pool.stats.max_wait_ns = wait_ns;
+    }
+    if (run_ns > pool.stats.max_run_ns)
+    {
+        pool.stats.max_run_ns = run_ns;
+    }
+    job->next = pool.done;
+    pool.done = job;
+    pthread_mutex_unlock(&pool.lock);
+
+    if (write(pool.efd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        syslog(LOG_ERR, "I/O pool eventfd write failed!: %s", strerror(errno));
+    }
+}
+
+uint64_t elapsed_ns(const struct timespec *from, const struct timespec *to)
+{
+    return (uint64_t) (to->tv_sec - from->tv_sec) * 1000000000ULL + to->tv_nsec - from->tv_nsec;
+}
@@ -0,0 +1,48 @@
+#ifndef IOPOOL_H
+#define IOPOOL_H
+
+#include <stdint.h>         /* fixed width integers                     */
+#include <time.h>           /* struct timespec                          */
+
+#define IOPOOL_MAXTHREADS 16
+
+/* A unit of blocking work, file system or name lookup, embedded in the caller's own struct */
+typedef struct io_job {
+    void (*run)(struct io_job *job);    /* runs on a pool thread            */
+    struct io_job *next;                /* completion list                  */
+    struct timespec queued;             /* submitted                        */
+    struct timespec started;            /* picked up by a thread            */
+    struct timespec finished;           /* run returned                     */
+} io_job;
+
+/* Counters to tell disk bound stalls from cpu bound ones */
+typedef struct {
+    uint64_t jobs;              /* completed jobs                       */
+    uint64_t inline_jobs;       /* run by the caller, the queue was full */
+    int depth;                  /* jobs waiting for a thread now        */
+    int max_depth;              /* highest depth seen                   */
+    uint64_t wait_ns;           /* total time spent in the queue        */
+    uint64_t max_wait_ns;       /* longest time spent in the queue      */
+    uint64_t run_ns;            /* total time spent running             */
+    uint64_t max_run_ns;        /* longest run                          */
+} iopool_stats;
+
+/* Start the threads, call after fork in the process that uses the pool */
+int iopool_init(int threads, int queue_size);
+
+/* Drain the queue, stop the threads, completions can still be collected */
+void iopool_shutdown();
+
+/* Readable when jobs completed, poll it in the serving loop */
+int iopool_fd();
+
+/* Queue a job, or run it right away if the pool is off or the queue is full,
+ * it is returned by iopool_complete either way */
+void iopool_submit(io_job *job);
+
+/* Next completed job, NULL if there is none */
+io_job * iopool_complete();
+
+void iopool_get_stats(iopool_stats *stats);
+
+#endif
@@ -0,0 +1,258 @@
+/* Library import */
+#include <stdio.h>          /* standard input output                */
+#include <stdlib.h>         /* standard library                     */
+#include <string.h>         /* for string functions                 */
+#include <fcntl.h>          /* for file operations                  */
+#include <unistd.h>         /* miscellaneous functions              */
+#include <errno.h>          /* error numbers                        */
+#include <dirent.h>         /* for directory listing                */
+#include <sys/stat.h>       /* for file status                      */
+
+/* Own headers */
+#include "config.h"         /* config header, PATHSIZE              */
+#include "pack.h"           /* pack header                          */
+
+#define BUFFSIZE 1024
+#define ALIGN(x) (((x) + PACK_ALIGN - 1) & ~((uint64_t) PACK_ALIGN - 1))
+
+typedef struct {
+    char path[PATHSIZE];        /* route, relative to the root  */
+    char filepath[PATHSIZE];    /* path on the file system      */
+    char header[BUFFSIZE];      /* precomputed headers          */
+    pack_entry entry;           /* index entry                  */
+} pack_file;
+
+/* Function declarations */
+int collect(const char *dir, const char *route, pack_file **files, int *count);
+int compare_files(const void *a, const void *b);
+int write_pack(const char *filename, pack_file *files, int count);
+int copy_file(int out, const char *filepath, uint64_t size);
+
+/* Compile a document root into a pack file */
+int main(int argc, char **argv)
+{
+    pack_file *files = NULL;
+    int count = 0;
+    char tmpname[PATHSIZE];
+
+    if (argc != 3)
+    {
+        printf("Usage: %s <document_root> <pack_file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if ( (collect(argv[1], "", &files, &count)) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    qsort(files, count, sizeof(pack_file), compare_files);
+
+    /* Write a temporary file and rename it, so a running server never sees a half pack */
+    snprintf(tmpname, PATHSIZE, "%s.tmp", argv[2]);
+    if ( (write_pack(tmpname, files, count)) != EXIT_SUCCESS)
+    {
+        unlink(tmpname);
+        return EXIT_FAILURE;
+    }
+    if (rename(tmpname, argv[2]) == -1)
+    {
+        fprintf(stderr, "Rename of %s failed!: %s\n", tmpname, strerror(errno));
+        unlink(tmpname);
+        return EXIT_FAILURE;
+    }
+
+    printf("%d files packed into %s\n", count, argv[2]);
+    free(files);
+    return EXIT_SUCCESS;
+}
+
+/* Walk the directory recursively and collect the regular files */
+int collect(const char *dir, const char *route, pack_file **files, int *count)
+{
+    DIR *dp;
+    struct dirent *de;
+    struct stat st;
+    char filepath[PATHSIZE];
+    char path[PATHSIZE];
+    pack_file *file;
+
+    dp = opendir(dir);
+    if (dp == NULL)
+    {
+        fprintf(stderr, "Cant open directory %s!: %s\n", dir, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    while ( (de = readdir(dp)) != NULL)
+    {
+        if (de->d_name[0] == '.')
+        {
+            continue;   /* ".", ".." and hidden files */
+        }
+
+        if (snprintf(filepath, PATHSIZE, "%s/%s", dir, de->d_name) >= PATHSIZE ||
+            snprintf(path, PATHSIZE, "%s/%s", route, de->d_name) >= PATHSIZE)
+        {
+            fprintf(stderr, "Path is too long: %s/%s\n", dir, de->d_name);
+            closedir(dp);
+            return EXIT_FAILURE;
+        }
+
+        if (stat(filepath, &st) == -1)
+        {
+            fprintf(stderr, "Cant stat %s!: %s\n", filepath, strerror(errno));
+            closedir(dp);
+            return EXIT_FAILURE;
+        }
+
+        if (S_ISDIR(st.st_mode))
+        {
+            if ( (collect(filepath, path, files, count)) != EXIT_SUCCESS)
+            {
+                closedir(dp);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (S_ISREG(st.st_mode))
+        {
+            file = realloc(*files, (*count + 1) * sizeof(pack_file));
+            if (file == NULL)
+            {
+                fprintf(stderr, "Out of memory!\n");
+                closedir(dp);
+                return EXIT_FAILURE;
+            }
+            *files = file;
+            file = &(*files)[(*count)++];
+
+            memset(file, 0, sizeof(pack_file));
+            strncpy(file->path, path, PATHSIZE - 1);
+            strncpy(file->filepath, filepath, PATHSIZE - 1);
+            file->entry.body_size = st.st_size;
+            file->entry.mtime = st.st_mtime;
+            file->entry.path_len = strnlen(file->path, PATHSIZE);
+            /* Same headers as send_header() */
+            file->entry.header_len = snprintf(file->header, BUFFSIZE,
+                "Content-Type: %s\r\nContent-Length: %d\r\n\r\n", "text/html", (int) st.st_size);
+        }
+    } /* end while */
+
+    closedir(dp);
+    return EXIT_SUCCESS;
+}
+
+int compare_files(const void *a, const void *b)
+{
+    return strcmp(((const pack_file *) a)->path, ((const pack_file *) b)->path);
+}
+
+int write_pack(const char *filename, pack_file *files, int count)
+{
+    pack_header header;
+    uint64_t offset;
+    int out;
+    int i;
+
+    /* Lay out the sections */
+    offset = sizeof(pack_header) + (uint64_t) count * sizeof(pack_entry);
+    for (i = 0; i < count; ++i)
+    {
+        files[i].entry.path_off = offset;
+        offset += files[i].entry.path_len + 1;
+    }
+    for (i = 0; i < count; ++i)
+    {
+        files[i].entry.header_off = offset;
+        offset += files[i].entry.header_len;
+    }
+    for (i = 0; i < count; ++i)
+    {
+        offset = ALIGN(offset);
+        files[i].entry.body_off = offset;
+        offset += files[i].entry.body_size;
+    }
+
+    out = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0)
+    {
+        fprintf(stderr, "Cant create %s!: %s\n", filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PACK_MAGIC, PACK_MAGICSIZE);
+    header.count = count;
+
+    if (write(out, &header, sizeof(header)) != sizeof(header))
+    {
+        goto failed;
+    }
+    for (i = 0; i < count; ++i)
+    {
+        if (write(out, &files[i].entry, sizeof(pack_entry)) != sizeof(pack_entry))
+        {
+            goto failed;
+        }
+    }
+    for (i = 0; i < count; ++i)
+    {
+        if (pwrite(out, files[i].path, files[i].entry.path_len + 1, files[i].entry.path_off)
+                != files[i].entry.path_len + 1 ||
+            pwrite(out, files[i].header, files[i].entry.header_len, files[i].entry.header_off)
+                != files[i].entry.header_len)
+        {
+            goto failed;
+        }
+    }
+    for (i = 0; i < count; ++i)
+    {
+        if (lseek(out, files[i].entry.body_off, SEEK_SET) == -1 ||
+            (copy_file(out, files[i].filepath, files[i].entry.body_size)) != EXIT_SUCCESS)
+        {
+            goto failed;
+        }
+    }
+
+    if (fsync(out) == -1)
+    {
+        goto failed;
+    }
+    close(out);
+    return EXIT_SUCCESS;
+
+failed:
+    fprintf(stderr, "Writing %s failed!: %s\n", filename, strerror(errno));
+    close(out);
+    return EXIT_FAILURE;
+}
+
+int copy_file(int out, const char *filepath, uint64_t size)
+{
+    char buffer[BUFFSIZE];
+    uint64_t copied = 0;
+    int length;
+    int fd;
+
+    fd = open(filepath, O_RDONLY);
+    if (fd < 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    while (copied < size && (length = read(fd, buffer, BUFFSIZE)) > 0)
+    {
+        if (length > size - copied)
+        {
+            length = size - copied; /* the file grew since the stat */
+        }
+        if (write(out, buffer, length) != length)
+        {
+            close(fd);
+            return EXIT_FAILURE;
+        }
+        copied += length;
+    }
+
+    close(fd);
+    return copied == size ? EXIT_SUCCESS : EXIT_FAILURE;
+}
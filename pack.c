@@ -0,0 +1,136 @@
+#include <stdio.h>          /* standard input output                    */
+#include <stdlib.h>         /* standard library                         */
+#include <string.h>         /* string functions                         */
+#include <fcntl.h>          /* for file operations                      */
+#include <unistd.h>         /* miscellaneous functions                  */
+#include <errno.h>          /* error numbers                            */
+#include <syslog.h>         /* syslog                                   */
+#include <sys/mman.h>       /* for mmap                                 */
+#include <sys/stat.h>       /* for file status                          */
+
+/* Own header */
+#include "pack.h"           /* pack header                              */
+
+int check_pack(const char *map, size_t size);
+
+int pack_open(pack *p, const char *filename)
+{
+    struct stat st;
+    const char *map;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        syslog(LOG_ERR, "Cant open pack file %s!: %s", filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t) sizeof(pack_header))
+    {
+        syslog(LOG_ERR, "Pack file %s is not valid!", filename);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        syslog(LOG_ERR, "Cant map pack file %s!: %s", filename, strerror(errno));
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    if ( (check_pack(map, st.st_size)) != EXIT_SUCCESS)
+    {
+        syslog(LOG_ERR, "Pack file %s is not valid!", filename);
+        munmap((void *) map, st.st_size);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    p->fd = fd;
+    p->map = map;
+    p->size = st.st_size;
+    p->count = ((const pack_header *) map)->count;
+    p->entries = (const pack_entry *) (map + sizeof(pack_header));
+
+    return EXIT_SUCCESS;
+}
+
+void pack_close(pack *p)
+{
+    if (p->map != NULL)
+    {
+        munmap((void *) p->map, p->size);
+        close(p->fd);
+    }
+    memset(p, 0, sizeof(pack));
+}
+
+const pack_entry * pack_lookup(const pack *p, const char *path)
+{
+    const pack_entry *entry;
+    int low = 0;
+    int high = (int) p->count - 1;
+    int mid;
+    int cmp;
+
+    while (low <= high)
+    {
+        mid = (low + high) / 2;
+        entry = &p->entries[mid];
+        cmp = strcmp(path, p->map + entry->path_off);
+        if (cmp == 0)
+        {
+            return entry;
+        }
+        else if (cmp < 0)
+        {
+            high = mid - 1;
+        }
+        else
+        {
+            low = mid + 1;
+        }
+    } /* end while */
+
+    return NULL;
+}
+
+/* Validate every offset once, so the lookups can trust the index */
+int check_pack(const char *map, size_t size)
+{
+    const pack_header *header = (const pack_header *) map;
+    const pack_entry *entries = (const pack_entry *) (map + sizeof(pack_header));
+    const pack_entry *entry;
+    uint32_t i;
+
+    if (memcmp(header->magic, PACK_MAGIC, PACK_MAGICSIZE) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (header->count > (size - sizeof(pack_header)) / sizeof(pack_entry))
+    {
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < header->count; ++i)
+    {
+        entry = &entries[i];
+        if (entry->path_off >= size || entry->path_len >= size - entry->path_off ||
+            map[entry->path_off + entry->path_len] != '\0' ||
+            entry->header_off > size || entry->header_len > size - entry->header_off ||
+            entry->body_off > size || entry->body_size > size - entry->body_off)
+        {
+            return EXIT_FAILURE;
+        }
+        if (i > 0 && strcmp(map + entries[i - 1].path_off, map + entry->path_off) >= 0)
+        {
+            return EXIT_FAILURE;
+        }
+    } /* end for */
+
+    return EXIT_SUCCESS;
+}
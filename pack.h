@@ -0,0 +1,49 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stdint.h>         /* fixed width integers                     */
+#include <stddef.h>         /* size_t                                   */
+
+#define PACK_MAGIC "WSPACK01"
+#define PACK_MAGICSIZE 8
+#define PACK_ALIGN 16       /* alignment of the bodies in the pack      */
+
+/* Pack file layout:
+ *  pack_header
+ *  pack_entry[count]       sorted by path
+ *  paths                   NUL terminated, "/index.html"
+ *  headers                 precomputed response headers
+ *  bodies                  file contents, PACK_ALIGN aligned
+*/
+typedef struct {
+    char     magic[PACK_MAGICSIZE];     /* PACK_MAGIC                   */
+    uint32_t count;                     /* number of entries            */
+    uint32_t reserved;
+} pack_header;
+
+typedef struct {
+    uint64_t path_off;                  /* offset of the path           */
+    uint64_t header_off;                /* offset of the headers        */
+    uint64_t body_off;                  /* offset of the body           */
+    uint64_t body_size;                 /* size of the body             */
+    int64_t  mtime;                     /* modification time of source  */
+    uint32_t path_len;                  /* length of the path           */
+    uint32_t header_len;                /* length of the headers        */
+} pack_entry;
+
+typedef struct {
+    int fd;                             /* pack file, source of sendfile */
+    const char *map;                    /* read only mapping             */
+    size_t size;                        /* size of the mapping           */
+    uint32_t count;                     /* number of entries             */
+    const pack_entry *entries;          /* sorted index                  */
+} pack;
+
+/* Map a pack file, the pack is left untouched on failure */
+int pack_open(pack *p, const char *filename);
+void pack_close(pack *p);
+
+/* Binary search of a route, NULL if not in the pack */
+const pack_entry * pack_lookup(const pack *p, const char *path);
+
+#endif
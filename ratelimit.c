@@ -0,0 +1,334 @@
+#include <stdio.h>          /* standard input output                    */
+#include <stdlib.h>         /* standard library                         */
+#include <string.h>         /* string functions                         */
+#include <stdint.h>         /* fixed width integers                     */
+#include <fcntl.h>          /* for file operations                      */
+#include <unistd.h>         /* miscellaneous functions                  */
+#include <errno.h>          /* error numbers                            */
+#include <time.h>           /* for clock_gettime                        */
+#include <sys/mman.h>       /* for shared memory                        */
+#include <arpa/inet.h>      /* for sockaddr_in, including <netinet/in.h> */
+
+/* Own headers */
+#include "config.h"         /* config header                            */
+#include "http_codes.h"     /* http codes header                        */
+#include "ratelimit.h"      /* own header                               */
+
+#define RL_USED (1ULL << 31)    /* marks an occupied slot owner             */
+#define RL_CONNS (RL_USED - 1)  /* active connections bits of the owner     */
+#define RL_OWNER(addr) (((uint64_t) (addr) << 32) | RL_USED)
+#define RL_TOKEN 1000           /* one request in milli-tokens              */
+#define RL_BODYSIZE 4096        /* maximum size of a preloaded error page   */
+
+/* One client slot, the owner packs the client IPv4 address (high 32 bits), RL_USED
+ * and the active connections, so an idle slot is handed to a new client with one CAS.
+ * The bucket packs the last refill time in ms (high 32 bits) and the available
+ * milli-tokens (low 32 bits) so it can be updated with one CAS */
+typedef struct {
+    uint64_t owner;                 /* RL_OWNER(address) | connections, 0 if empty */
+    uint64_t bucket[RL_CLASSES];    /* token buckets of the route classes          */
+} rl_slot;
+
+/* Preloaded rejecting response */
+typedef struct {
+    char *buffer;       /* status, header and body      */
+    int header_len;     /* length without the body      */
+    int len;            /* length with the body         */
+} rl_response;
+
+static rl_slot *table = NULL;
+static int max_conns = 0;
+static uint32_t rate[RL_CLASSES];
+static uint32_t burst[RL_CLASSES];
+static rl_response resp_429;
+static rl_response resp_503;
+
+static int preload_response(rl_response *resp, const char *status, const char *err_dir, int status_code);
+static rl_slot * lookup(in_addr_t addr, int claim);
+static int idle_slot(rl_slot *slot, uint64_t owner, uint32_t now);
+static uint64_t refill(uint64_t bucket, rl_class cls, uint32_t now);
+static uint32_t now_ms();
+
+int rl_init(const config *conf)
+{
+    max_conns = conf->rate_conns;
+    rate[RL_STATIC] = conf->rate_static;
+    burst[RL_STATIC] = conf->rate_static_burst > 0 ? conf->rate_static_burst : conf->rate_static;
+    rate[RL_CGI] = conf->rate_cgi;
+    burst[RL_CGI] = conf->rate_cgi_burst > 0 ? conf->rate_cgi_burst : conf->rate_cgi;
+
+    if (max_conns == 0 && rate[RL_STATIC] == 0 && rate[RL_CGI] == 0)
+    {
+        return EXIT_SUCCESS; /* Rate limiting is disabled */
+    }
+
+    /* Shared between the parent and every forked worker */
+    table = mmap(NULL, sizeof(rl_slot) * RL_TABLESIZE, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED)
+    {
+        fprintf(stderr, "Rate limit table allocation failed!: %s\n", strerror(errno));
+        table = NULL;
+        return EXIT_FAILURE;
+    }
+
+    if ( (preload_response(&resp_429, HTTP_429, conf->err_dir, 429)) != EXIT_SUCCESS ||
+         (preload_response(&resp_503, HTTP_503, conf->err_dir, 503)) != EXIT_SUCCESS)
+    {
+        fprintf(stderr, "Rate limit response allocation failed!\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int rl_conn_acquire(struct sockaddr_in *client_addr)
+{
+    uint64_t key = RL_OWNER(client_addr->sin_addr.s_addr);
+    uint64_t old;
+    rl_slot *slot;
+
+    if (table == NULL || max_conns == 0)
+    {
+        return 0;
+    }
+
+    while ( (slot = lookup(client_addr->sin_addr.s_addr, 1)) != NULL)
+    {
+        old = __atomic_load_n(&slot->owner, __ATOMIC_ACQUIRE);
+        while ((old & ~RL_CONNS) == key)
+        {
+            if ((old & RL_CONNS) >= (uint64_t) max_conns)
+            {
+                return 503; /* Service unavailable */
+            }
+            if (__atomic_compare_exchange_n(&slot->owner, &old, old + 1, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                return 0;
+            }
+        }
+        /* Handed to another client meanwhile, look again */
+    }
+
+    return 503; /* No free slot, a full table must not let the clients through */
+}
+
+void rl_conn_release(struct sockaddr_in *client_addr)
+{
+    uint64_t key = RL_OWNER(client_addr->sin_addr.s_addr);
+    uint64_t old;
+    rl_slot *slot;
+
+    if (table == NULL || max_conns == 0)
+    {
+        return;
+    }
+
+    /* A slot with connections is never reclaimed, it is still there */
+    slot = lookup(client_addr->sin_addr.s_addr, 0);
+    if (slot == NULL)
+    {
+        return;
+    }
+
+    old = __atomic_load_n(&slot->owner, __ATOMIC_ACQUIRE);
+    while ((old & ~RL_CONNS) == key && (old & RL_CONNS) > 0)
+    {
+        if (__atomic_compare_exchange_n(&slot->owner, &old, old - 1, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            break;
+        }
+    }
+}
+
+int rl_request(struct sockaddr_in *client_addr, const char *route)
+{
+    rl_class cls = RL_STATIC;
+    rl_slot *slot;
+    uint64_t old, new;
+    uint64_t tokens;
+    uint32_t now;
+
+    if (route != NULL && strncmp(route, "/cgi/", 5) == 0)
+    {
+        cls = RL_CGI;
+    }
+
+    if (table == NULL || rate[cls] == 0)
+    {
+        return 0;
+    }
+
+    slot = lookup(client_addr->sin_addr.s_addr, 1);
+    if (slot == NULL)
+    {
+        return 429; /* No free slot, a full table must not let the clients through */
+    }
+
+    now = now_ms();
+    old = __atomic_load_n(&slot->bucket[cls], __ATOMIC_ACQUIRE);
+    do
+    {
+        tokens = refill(old, cls, now);
+        if (tokens < RL_TOKEN)
+        {
+            return 429; /* Too many requests */
+        }
+
+        new = ((uint64_t) now << 32) | (tokens - RL_TOKEN);
+    } while (!__atomic_compare_exchange_n(&slot->bucket[cls], &old, new, 0,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    return 0;
+}
+
+void rl_send_reject(int connection, int status_code, int with_body)
+{
+    rl_response *resp = (status_code == 429) ? &resp_429 : &resp_503;
+
+    if (resp->buffer == NULL)
+    {
+        return;
+    }
+    write(connection, resp->buffer, with_body ? resp->len : resp->header_len);
+}
+
+
+/* Build the whole response once, so a rejection is a single write */
+static int preload_response(rl_response *resp, const char *status, const char *err_dir, int status_code)
+{
+    char filepath[PATHSIZE];
+    char body[RL_BODYSIZE];
+    int body_len = 0;
+    int size;
+    int fd;
+
+    snprintf(filepath, PATHSIZE, "%s/%d.html", err_dir, status_code);
+    fd = open(filepath, O_RDONLY);
+    if (fd >= 0)
+    {
+        body_len = read(fd, body, RL_BODYSIZE);
+        if (body_len < 0)
+        {
+            body_len = 0;
+        }
+        close(fd);
+    }
+
+    size = PATHSIZE + body_len;
+    resp->buffer = malloc(size);
+    if (resp->buffer == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    resp->header_len = snprintf(resp->buffer, size,
+        "%s\r\nContent-Type: text/html\r\nContent-Length: %d\r\n\r\n", status, body_len);
+    memcpy(resp->buffer + resp->header_len, body, body_len);
+    resp->len = resp->header_len + body_len;
+
+    return EXIT_SUCCESS;
+}
+
+/* Find or claim the slot of a client, lock free open addressing. Slots are never
+ * emptied, an idle one in the probe window is handed over to the new client */
+static rl_slot * lookup(in_addr_t addr, int claim)
+{
+    uint64_t key = RL_OWNER(addr);
+    uint64_t cur;
+    uint64_t idle_owner = 0;
+    uint32_t hash = ((uint32_t) addr * 2654435761U) >> (32 - RL_TABLEBITS); /* Fibonacci hashing */
+    uint32_t now = now_ms();
+    rl_slot *idle = NULL;
+    rl_slot *slot;
+    int i;
+
+    for (i = 0; i < RL_MAXPROBE; ++i)
+    {
+        slot = &table[(hash + i) & (RL_TABLESIZE - 1)];
+        cur = __atomic_load_n(&slot->owner, __ATOMIC_ACQUIRE);
+        if ((cur & ~RL_CONNS) == key)
+        {
+            return slot;
+        }
+        if (cur == 0)
+        {
+            /* The end of the chain, the client has no slot yet */
+            if (!claim)
+            {
+                return NULL;
+            }
+            if (__atomic_compare_exchange_n(&slot->owner, &cur, key, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) || (cur & ~RL_CONNS) == key)
+            {
+                return slot;
+            }
+        }
+        else if (claim && idle == NULL && idle_slot(slot, cur, now))
+        {
+            idle = slot;
+            idle_owner = cur;
+        }
+    } /* end for */
+
+    if (idle == NULL)
+    {
+        return NULL;
+    }
+
+    /* Take over the idle slot, it fails if its client came back meanwhile */
+    if (!__atomic_compare_exchange_n(&idle->owner, &idle_owner, key, 0,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        return (idle_owner & ~RL_CONNS) == key ? idle : NULL;
+    }
+    for (i = 0; i < RL_CLASSES; ++i)
+    {
+        __atomic_store_n(&idle->bucket[i], 0, __ATOMIC_RELEASE); /* Starts full */
+    }
+    return idle;
+}
+
+/* No connection and every bucket refilled, the client would start from the same state */
+static int idle_slot(rl_slot *slot, uint64_t owner, uint32_t now)
+{
+    int i;
+
+    if ((owner & RL_CONNS) != 0)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < RL_CLASSES; ++i)
+    {
+        if (rate[i] != 0 &&
+            refill(__atomic_load_n(&slot->bucket[i], __ATOMIC_ACQUIRE), i, now) < (uint64_t) burst[i] * RL_TOKEN)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Milli-tokens of a bucket refilled since its last update, a new slot (time 0) starts full */
+static uint64_t refill(uint64_t bucket, rl_class cls, uint32_t now)
+{
+    uint32_t elapsed = now - (uint32_t) (bucket >> 32);
+    uint64_t tokens = (bucket & 0xffffffff) + (uint64_t) elapsed * rate[cls];
+
+    if (tokens > (uint64_t) burst[cls] * RL_TOKEN)
+    {
+        tokens = (uint64_t) burst[cls] * RL_TOKEN;
+    }
+    return tokens;
+}
+
+static uint32_t now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) (ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
@@ -0,0 +1,23 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#define RL_TABLEBITS 12                     /* log2 of the table size           */
+#define RL_TABLESIZE (1 << RL_TABLEBITS)    /* client slots in shared memory    */
+#define RL_MAXPROBE 16                      /* linear probes for a lookup       */
+
+typedef enum {RL_STATIC = 0, RL_CGI, RL_CLASSES} rl_class;
+
+/* Set up the shared table and the preloaded responses, call before fork */
+int rl_init(const config *conf);
+
+/* Per client concurrent connections, returns 0 or the rejecting status code */
+int rl_conn_acquire(struct sockaddr_in *client_addr);
+void rl_conn_release(struct sockaddr_in *client_addr);
+
+/* Per client request rate, returns 0 or the rejecting status code */
+int rl_request(struct sockaddr_in *client_addr, const char *route);
+
+/* Send the preloaded 429 or 503 response */
+void rl_send_reject(int connection, int status_code, int with_body);
+
+#endif
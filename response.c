@@ -1,6 +1,9 @@
+#define _GNU_SOURCE         /* for readahead                            */
+
 #include <stdio.h>          /* standard input output                    */
 #include <stdlib.h>         /* standard library                         */
 #include <string.h>         /* string functions                         */
+#include <strings.h>        /* for strcasecmp                           */
 #include <fcntl.h>          /* for file operations                      */
 #include <unistd.h>         /* miscellaneous functions                  */
 #include <sys/socket.h>     /* socket handling                          */
@@ -14,12 +17,21 @@
 
 /* Own headers */
 #include "config.h"		    /* config header                            */
+#include "response.h"       /* response header                          */
 #include "http_codes.h"     /* http codes header                        */
+#include "ratelimit.h"      /* rate limit header                        */
+#include "pack.h"           /* pack header                              */
+#include "arena.h"          /* arena header                             */
+#include "trace.h"          /* trace header                             */
+#include "http2.h"          /* http2 header                             */
 
 #define BUFFSIZE 1024
-#define REQUESTSIZE 10240
+#define REQUESTSLAB 8192    /* slab behind the request buffer */
+#define UPGRADESIZE 8       /* "h2c", longer values are not an upgrade */
 #define REQLINE 256
 #define NOTALLOWEDCHARS " '`"
+#define PREFETCHSIZE (128 * 1024)       /* smaller bodies are not prefetched    */
+#define READAHEADSIZE (2 * 1024 * 1024) /* read into the page cache up front    */
 
 typedef int bool;
 #define true 1
@@ -27,6 +39,9 @@ typedef int bool;
 
 typedef enum {HEAD = 0, GET, POST} req_type;
 
+static pack root_pack;  /* mapped html root, if configured         */
+static pack err_pack;   /* mapped error html pages, if configured  */
+
 typedef struct {
    req_type type;  /* http request type    */
    char *route;    /* http request route   */
@@ -36,73 +51,170 @@ typedef struct {
 
 /* request parser */
 int parse_request(char *req_buffer, request *req);
+int get_header(const char *req_buffer, const char *name, char *value, int size);
 
 /* response functions */
-int head_response(config conf, int connection, const char *route);
-int get_response(config conf, int connection, const char *route);
-int post_response(config conf, int connection, const char *route, char *params);
+int head_response(const config *conf, int connection, const char *route, trace *tr);
+int get_response(const config *conf, int connection, const char *route, trace *tr);
+int post_response(const config *conf, int connection, const char *route, char *params, trace *tr);
 
 /* error handler function */
-void error_handler(config conf, int connection, int status_code, req_type type);
+void error_handler(const config *conf, int connection, int status_code, req_type type, trace *tr);
+
+/* content functions */
+int open_file_content(const char *filepath, int status_code, content *cont);
+int open_pack_content(const pack *p, const char *route, int status_code, content *cont);
 
 /* response helper functions */
 void send_status(int connection, int status_code);
-void send_header(int connection, const char *filepath, int filesize);
-int send_content(int connection, const char *filepath, int filesize);
+void send_header(int connection, const content *cont);
+int send_content(int connection, content *cont);
+
+/* pack functions */
+int load_pack(pack *p, const char *filename);
 
 /* misc functions */ 
-int get_file_size(const char *filepath);
 const char * resolve_addr(struct sockaddr_in *addr, bool dns_resolve);
 const char * resolve_http_code(int http_code);
 const char * get_datetime();
 
 
-int response(config conf, int connection, struct sockaddr_in *client_addr)
+int response_init(const config *conf)
+{
+    if ( (load_pack(&root_pack, conf->root_pack)) != EXIT_SUCCESS ||
+         (load_pack(&err_pack, conf->err_pack)) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int response(const config *conf, int connection, struct sockaddr_in *client_addr)
 {
-    char req_buffer[REQUESTSIZE];
+    arena mem;              /* request state, released with the response */
+    trace tr;               /* stage timings of the request               */
+    char *req_buffer;
+    size_t req_size;
     request req;
-    char req_type_str[BUFFSIZE];
+    const char *method = "";
+    char upgrade[UPGRADESIZE];
+    char *settings = NULL;
+    char *rest = NULL;
+    int rest_len = 0;
+    h2_upgrade h2c;
+    slab_stats slabs;
     int status_code = 400; /* Bad request */
+    int result = EXIT_SUCCESS;
+    int parsed;
     int rcvd;
+    int more;
+    char *end;
+
+    /* The request fills one slab, the other buffers come from the arena only when needed */
+    arena_init(&mem);
+    req_size = arena_fit(REQUESTSLAB);
+    req_buffer = arena_alloc(&mem, req_size);
+    if (req_buffer == NULL)
+    {
+        syslog(LOG_ERR, "Request buffer allocation failed!");
+        return EXIT_FAILURE;
+    }
 
-    memset(req_buffer, 0, sizeof(req_buffer));
-
-    rcvd = recv(connection, req_buffer, REQUESTSIZE, 0);
+    trace_begin(&tr);
+    trace_start(&tr, TRACE_RECV);
+    rcvd = recv(connection, req_buffer, req_size - 1, 0);
     if (rcvd < 0)
     {
         syslog(LOG_ERR, "Client disconnected unexpectedly.");
-        return EXIT_FAILURE;
+        result = EXIT_FAILURE;
+        goto done;
     }
-    
+
+    /* HTTP/2 with prior knowledge, the preface can arrive in pieces */
+    while (rcvd > 0 && rcvd < H2_PREFACE_LEN && memcmp(req_buffer, H2_PREFACE, rcvd) == 0)
+    {
+        if ( (more = recv(connection, req_buffer + rcvd, req_size - 1 - rcvd, 0)) <= 0)
+        {
+            break;
+        }
+        rcvd += more;
+    }
+    trace_end(&tr, TRACE_RECV);
+
+    if (rcvd >= H2_PREFACE_LEN && memcmp(req_buffer, H2_PREFACE, H2_PREFACE_LEN) == 0)
+    {
+        result = http2_response(conf, connection, client_addr, &mem, req_buffer, rcvd, NULL);
+        goto done;
+    }
+
+    /* HTTP/1.1 upgrade to h2c, save what follows the request before the parser splits it */
+    trace_start(&tr, TRACE_PARSE);
+    if ( (get_header(req_buffer, "Upgrade", upgrade, UPGRADESIZE)) == EXIT_SUCCESS &&
+        strcasecmp(upgrade, "h2c") == 0 &&
+        (settings = arena_alloc(&mem, BUFFSIZE)) != NULL &&
+        (get_header(req_buffer, "HTTP2-Settings", settings, BUFFSIZE)) == EXIT_SUCCESS &&
+        (end = strstr(req_buffer, "\r\n\r\n")) != NULL)
+    {
+        rest_len = rcvd - (end + 4 - req_buffer);
+        rest = arena_alloc(&mem, rest_len + 1);
+        if (rest != NULL)
+        {
+            memcpy(rest, end + 4, rest_len);
+        }
+    }
+
+    parsed = parse_request(req_buffer, &req);
+    trace_end(&tr, TRACE_PARSE);
+
     /* Response */
-    if ( (parse_request(req_buffer, &req)) == EXIT_SUCCESS)
+    if (parsed == EXIT_SUCCESS)
     {
+        /* Rate limit, rejected with the preloaded response */
+        if ( (status_code = rl_request(client_addr, req.route)) != 0)
+        {
+            rl_send_reject(connection, status_code, req.type != HEAD);
+            syslog(LOG_NOTICE, "%d %s (%s)", status_code, req.route,
+                resolve_addr(client_addr, false));
+            goto done;
+        }
+
+        /* for GET and HEAD request to "/" route give the "/index.html" */
+        if (req.type != POST && strncmp(req.route, "/", BUFFSIZE) == 0)
+        {
+            strncpy(req.route, "/index.html", PATHSIZE);
+        }
+
+        /* The upgraded request is answered on stream 1 */
+        if (rest != NULL && req.type != POST)
+        {
+            h2c.head = (req.type == HEAD);
+            h2c.route = req.route;
+            h2c.settings = settings;
+            result = http2_response(conf, connection, client_addr, &mem, rest, rest_len, &h2c);
+            goto done;
+        }
+
         switch (req.type)
         {
             case GET:
-                /* for GET request to "/" route give the "/index.html" */
-                if (strncmp(req.route, "/", BUFFSIZE) == 0)
-                {
-                    strncpy(req.route, "/index.html", PATHSIZE);
-                }
-                status_code = get_response(conf, connection, req.route);
-                strncpy(req_type_str, "GET", BUFFSIZE);
+                status_code = get_response(conf, connection, req.route, &tr);
+                method = "GET";
                 break;
             case HEAD:
-                status_code = head_response(conf, connection, req.route);
-                strncpy(req_type_str, "HEAD", BUFFSIZE);
+                status_code = head_response(conf, connection, req.route, &tr);
+                method = "HEAD";
                 break;
             case POST:
                 /* POST request route begins only with /cgi/ */
                 if (strncmp(req.route, "/cgi/", 5) == 0)
                 {
-                    status_code = post_response(conf, connection, req.route + 5, req.params);
+                    status_code = post_response(conf, connection, req.route + 5, req.params, &tr);
                 }
                 else
                 {
                     status_code = 400;  /* Bad request */
                 }
-                strncpy(req_type_str, "POST", BUFFSIZE);
+                method = "POST";
                 break;
             default:
                 break;
@@ -112,14 +224,19 @@ int response(config conf, int connection, struct sockaddr_in *client_addr)
     /* Check the status code */
     if (status_code != 200)
     {
-        error_handler(conf, connection, status_code, req.type);
+        error_handler(conf, connection, status_code, req.type, &tr);
     }
 
     /* Log the response */
-    syslog(LOG_INFO, "%d %s %s (%s)", status_code, req_type_str, req.route,
-        resolve_addr(client_addr, true));
+    log_response(conf, status_code, method, req.route, client_addr, &tr);
 
-    return EXIT_SUCCESS;
+    /* Memory of an HTTP/1 request, HTTP/2 logs its own per connection */
+    slab_get_stats(&slabs);
+    syslog(LOG_DEBUG, "Memory: %zu bytes at peak, %zu bytes of request", slabs.peak, mem.used);
+
+done:
+    arena_reset(&mem);
+    return result;
 }
 
 /* request parser */
@@ -128,15 +245,22 @@ int parse_request(char *req_buffer, request *req)
     char *reqline[REQLINE];
     int reqline_len = 0;
     req->type = 0;
+    req->route = "";    /* logged even if the request is not valid */
 
     /* Split by "\r\n" */
     reqline[reqline_len] = strtok(req_buffer, "\r\n");
-    while (reqline[reqline_len] != NULL)
+    while (reqline[reqline_len] != NULL && reqline_len < REQLINE - 1)
     {
         ++reqline_len;
         reqline[reqline_len] = strtok(NULL, "\r\n");
     }
 
+    /* The client closed the connection without sending anything */
+    if (reqline_len == 0)
+    {
+        return EXIT_FAILURE;
+    }
+
     /* Get the request type */
     if (strncmp(reqline[0], "GET", 3) == 0)
     {
@@ -195,104 +319,276 @@ int parse_request(char *req_buffer, request *req)
 }
 
 
-/* Response functions */
-int get_response(config conf, int connection, const char *route)
+/* Value of a request header, before the request is parsed */
+int get_header(const char *req_buffer, const char *name, char *value, int size)
 {
-    char filepath[PATHSIZE];
-    int filesize = 0;
+    const char *line = strstr(req_buffer, "\r\n");
+    int name_len = strlen(name);
+    int len;
+
+    while (line != NULL && line[2] != '\r' && line[2] != '\0')
+    {
+        line += 2;
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':')
+        {
+            line += name_len + 1;
+            line += strspn(line, " \t");
+            len = strcspn(line, "\r\n");
+            if (len >= size)
+            {
+                return EXIT_FAILURE;
+            }
+            memcpy(value, line, len);
+            value[len] = '\0';
+            return EXIT_SUCCESS;
+        }
+        line = strstr(line, "\r\n");
+    } /* end while */
+
+    return EXIT_FAILURE;
+}
 
-    strncpy(filepath, conf.root_dir, PATHSIZE);
-    strncat(filepath, route, PATHSIZE);
 
-    if (access(filepath, R_OK) != 0)
+/* Response functions */
+int get_response(const config *conf, int connection, const char *route, trace *tr)
+{
+    content cont;
+    int status_code = 200; /* OK */
+    int opened;
+
+    trace_start(tr, TRACE_OPEN);
+    opened = open_content(conf, route, &cont);
+    trace_end(tr, TRACE_OPEN);
+    if (opened != EXIT_SUCCESS)
     {
         return 404; /* Not found */
     }
 
-    filesize = get_file_size(filepath);
+    trace_start(tr, TRACE_SEND);
     send_status(connection, 200); /* OK */
-    send_header(connection, filepath, filesize);
-    if ( (send_content(connection, filepath, filesize)) != EXIT_SUCCESS)
+    send_header(connection, &cont);
+    if ( (send_content(connection, &cont)) != EXIT_SUCCESS)
     {
-        return 500; /* Internal server error */
+        status_code = 500; /* Internal server error */
     }
+    trace_end(tr, TRACE_SEND);
 
-    return 200; /* OK */
+    close_content(&cont);
+    return status_code;
 }
 
-int head_response(config conf, int connection, const char *route)
+int head_response(const config *conf, int connection, const char *route, trace *tr)
 {
-    char filepath[PATHSIZE];
-        
-    strncpy(filepath, conf.root_dir, PATHSIZE);
-    strncat(filepath, route, PATHSIZE);
+    content cont;
+    int opened;
 
-    if (access(filepath, R_OK) != 0)
+    trace_start(tr, TRACE_OPEN);
+    opened = open_content(conf, route, &cont);
+    trace_end(tr, TRACE_OPEN);
+    if (opened != EXIT_SUCCESS)
     {
         return 404; /* Not found */
     }
 
+    trace_start(tr, TRACE_SEND);
     send_status(connection, 200); /* OK */
-    send_header(connection, filepath, get_file_size(filepath));
-    
+    send_header(connection, &cont);
+    trace_end(tr, TRACE_SEND);
+
+    close_content(&cont);
     return 200; /* OK */
 }
 
-int post_response(config conf, int connection, const char *route, char *params)
+int post_response(const config *conf, int connection, const char *route, char *params, trace *tr)
 {
-    FILE* fd;
+    content cont;
     char buffer[BUFFSIZE];
-    int length;
-
-    /* Cut by the first not allowed character */
-    strtok(params, NOTALLOWEDCHARS);
+    int opened;
 
-    /* Create the command */
-    snprintf(buffer, BUFFSIZE, "%s %s/%s '%s'", conf.cgi_cmd, conf.cgi_dir, route, params);
-    
-    fd = popen(buffer, "r");
-    if (fd == NULL)
+    trace_start(tr, TRACE_CGI);
+    opened = open_cgi_content(conf, route, params, &cont);
+    trace_end(tr, TRACE_CGI);
+    if (opened != EXIT_SUCCESS)
     {
-        syslog(LOG_ERR, "Failed to run command!: %s", strerror(errno));
         return 500; /* Internal server error */
     }
 
+    /* Includes waiting for the cgi output */
+    trace_start(tr, TRACE_SEND);
     send_status(connection, 200); /* OK */
 
     snprintf(buffer, BUFFSIZE, "\r\n");
     write(connection, buffer, strnlen(buffer, BUFFSIZE));
 
-    while ( (length = read(fileno(fd), buffer, BUFFSIZE)) > 0)
-    {
-        write(connection, buffer, length);
-    }
+    send_content(connection, &cont);
+    trace_end(tr, TRACE_SEND);
+
+    close_content(&cont);
     return 200; /* OK */
 }
 
 
 /* error handler function */
-void error_handler(config conf, int connection, int status_code, req_type type)
+void error_handler(const config *conf, int connection, int status_code, req_type type, trace *tr)
 {
-    char filepath[PATHSIZE];
-    int filesize = 0;
-    
-    snprintf(filepath, PATHSIZE, "%s/%d.html", conf.err_dir, status_code);
- 
-    if (access(filepath, R_OK) != 0)
+    content cont;
+    int opened;
+
+    trace_start(tr, TRACE_OPEN);
+    opened = open_error_content(conf, status_code, &cont);
+    trace_end(tr, TRACE_OPEN);
+
+    trace_start(tr, TRACE_SEND);
+    if (opened != EXIT_SUCCESS)
     {
         /* Short response */
         send_status(connection, status_code);
+        trace_end(tr, TRACE_SEND);
+        return;
     }
 
     /* Long response */
-    filesize = get_file_size(filepath);
     send_status(connection, status_code);
-    send_header(connection, filepath, filesize);
+    send_header(connection, &cont);
     
     if (type == GET || type == POST)
     {
-        send_content(connection, filepath, filesize);
+        send_content(connection, &cont);
+    }
+    trace_end(tr, TRACE_SEND);
+
+    close_content(&cont);
+}
+
+
+/* content functions */
+int open_content(const config *conf, const char *route, content *cont)
+{
+    char filepath[PATHSIZE];
+
+    /* The pack replaces the html root, no file system access */
+    if (root_pack.map != NULL)
+    {
+        return open_pack_content(&root_pack, route, 200, cont);
+    }
+
+    snprintf(filepath, PATHSIZE, "%s%s", conf->root_dir, route);
+    return open_file_content(filepath, 200, cont);
+}
+
+int open_error_content(const config *conf, int status_code, content *cont)
+{
+    char filepath[PATHSIZE];
+
+    /* The pack replaces the error html directory */
+    if (err_pack.map != NULL)
+    {
+        snprintf(filepath, PATHSIZE, "/%d.html", status_code);
+        return open_pack_content(&err_pack, filepath, status_code, cont);
+    }
+
+    snprintf(filepath, PATHSIZE, "%s/%d.html", conf->err_dir, status_code);
+    return open_file_content(filepath, status_code, cont);
+}
+
+int open_cgi_content(const config *conf, const char *route, char *params, content *cont)
+{
+    char buffer[BUFFSIZE];
+
+    memset(cont, 0, sizeof(content));
+    cont->fd = -1;
+
+    /* Cut by the first not allowed character */
+    strtok(params, NOTALLOWEDCHARS);
+
+    /* Create the command */
+    snprintf(buffer, BUFFSIZE, "%s %s/%s '%s'", conf->cgi_cmd, conf->cgi_dir, route, params);
+    
+    cont->pipe = popen(buffer, "r");
+    if (cont->pipe == NULL)
+    {
+        syslog(LOG_ERR, "Failed to run command!: %s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    cont->status_code = 200; /* OK */
+    cont->fd = fileno(cont->pipe);
+    cont->size = -1;
+    return EXIT_SUCCESS;
+}
+
+void close_content(content *cont)
+{
+    if (cont->pipe != NULL)
+    {
+        pclose(cont->pipe);
+    }
+    else if (cont->owned && cont->fd >= 0)
+    {
+        close(cont->fd);
     }
+    memset(cont, 0, sizeof(content));
+    cont->fd = -1;
+}
+
+/* Pull a large body into the page cache, so sending it does not wait for the disk */
+void prefetch_content(const content *cont)
+{
+    if (cont->pipe != NULL || cont->fd < 0 || cont->size < PREFETCHSIZE)
+    {
+        return;
+    }
+
+    posix_fadvise(cont->fd, cont->offset, cont->size, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(cont->fd, cont->offset, cont->size, POSIX_FADV_WILLNEED);
+
+    /* The start is read synchronously, the kernel keeps ahead of the rest */
+    readahead(cont->fd, cont->offset, cont->size < READAHEADSIZE ? cont->size : READAHEADSIZE);
+}
+
+int open_file_content(const char *filepath, int status_code, content *cont)
+{
+    struct stat st;
+
+    memset(cont, 0, sizeof(content));
+    cont->fd = open(filepath, O_RDONLY);
+    if (cont->fd < 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (fstat(cont->fd, &st) == -1 || !S_ISREG(st.st_mode))
+    {
+        close(cont->fd);
+        cont->fd = -1;
+        return EXIT_FAILURE;
+    }
+
+    cont->status_code = status_code;
+    cont->size = st.st_size;
+    cont->owned = true;
+    return EXIT_SUCCESS;
+}
+
+int open_pack_content(const pack *p, const char *route, int status_code, content *cont)
+{
+    const pack_entry *entry;
+
+    memset(cont, 0, sizeof(content));
+    cont->fd = -1;
+
+    if ( (entry = pack_lookup(p, route)) == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    cont->status_code = status_code;
+    cont->fd = p->fd;
+    cont->offset = entry->body_off;
+    cont->size = entry->body_size;
+    cont->header = p->map + entry->header_off;
+    cont->header_len = entry->header_len;
+    return EXIT_SUCCESS;
 }
 
 
@@ -305,49 +601,103 @@ void send_status(int connection, int status_code)
     write(connection, buffer, strnlen(buffer, BUFFSIZE));
 }
 
-void send_header(int connection, const char *filepath, int filesize)
+void send_header(int connection, const content *cont)
 {
     char buffer[BUFFSIZE];
 
+    /* Precomputed headers of a pack entry */
+    if (cont->header != NULL)
+    {
+        write(connection, cont->header, cont->header_len);
+        return;
+    }
+
     snprintf(buffer, BUFFSIZE, "Content-Type: %s\r\n", "text/html");
     write(connection, buffer, strnlen(buffer, BUFFSIZE));
 
-    snprintf(buffer, BUFFSIZE, "Content-Length: %d\r\n\r\n", filesize);
+    snprintf(buffer, BUFFSIZE, "Content-Length: %d\r\n\r\n", (int) cont->size);
     write(connection, buffer, strnlen(buffer, BUFFSIZE));
 }
 
-int send_content(int connection, const char *filepath, int filesize)
+int send_content(int connection, content *cont)
 {
-    int fd;
+    char buffer[BUFFSIZE];
+    off_t offset = cont->offset;
+    off_t remaining = cont->size;
+    ssize_t sent;
+    int length;
 
-    fd = open(filepath, O_RDONLY);
-    if (fd < 0)
+    /* CGI output, copy until the end */
+    if (cont->pipe != NULL)
     {
-        syslog(LOG_ERR, "Cant open file!: %s", strerror(errno));
-        return EXIT_FAILURE;
+        while ( (length = read(cont->fd, buffer, BUFFSIZE)) > 0)
+        {
+            write(connection, buffer, length);
+        }
+        return EXIT_SUCCESS;
     }
 
-    if ( (sendfile(connection, fd, 0, filesize)) < 0)
+    /* File or pack entry with sendfile at its offset */
+    while (remaining > 0)
     {
-        syslog(LOG_ERR, "Failed send file!: %s", strerror(errno));
-        close(fd);
-        return EXIT_FAILURE;
+        sent = sendfile(connection, cont->fd, &offset, remaining);
+        if (sent <= 0)
+        {
+            syslog(LOG_ERR, "Failed send file!: %s", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        remaining -= sent;
     }
 
-    close(fd);
     return EXIT_SUCCESS;
 }
 
 
-/* MISC functions */ 
-int get_file_size(const char *filepath)
+/* pack functions */
+int load_pack(pack *p, const char *filename)
 {
-    struct stat st;
-    if (stat(filepath, &st) == -1)
+    pack fresh;
+
+    if (filename[0] == '\0')
     {
-        return 0;
+        return EXIT_SUCCESS; /* Not configured */
     }
-    return st.st_size;
+
+    /* Map the new pack first, the old one stays if it fails */
+    if ( (pack_open(&fresh, filename)) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    pack_close(p);
+    *p = fresh;
+    return EXIT_SUCCESS;
+}
+
+
+/* MISC functions */ 
+void log_response(const config *conf, int status_code, const char *method, const char *route,
+    struct sockaddr_in *client_addr, trace *tr)
+{
+    const char *name;
+
+    trace_start(tr, TRACE_RESOLVE);
+    name = resolve_addr(client_addr, conf->dns);
+    trace_end(tr, TRACE_RESOLVE);
+
+    log_named_response(status_code, method, route, name, tr);
+}
+
+void log_named_response(int status_code, const char *method, const char *route,
+    const char *name, trace *tr)
+{
+    char fields[TRACE_FIELDSIZE];
+
+    /* The request ends with its log line */
+    trace_finish(tr, status_code, method, route);
+    trace_format(tr, fields, sizeof(fields));
+
+    syslog(LOG_INFO, "%d %s %s (%s)%s", status_code, method, route, name, fields);
 }
 
 const char * resolve_addr(struct sockaddr_in *addr, bool dns_resolve)
@@ -384,6 +734,7 @@ const char * resolve_http_code(int http_code)
         case 401: return HTTP_401;
         case 403: return HTTP_403;
         case 404: return HTTP_404;
+        case 429: return HTTP_429;
         case 500: return HTTP_500;
         case 501: return HTTP_501;
         case 502: return HTTP_502;
@@ -1,6 +1,44 @@
 #ifndef RESPONSE_H
 #define RESPONSE_H
 
-int response(config conf, int connection, struct sockaddr_in *client_address);
+#include <stdio.h>          /* FILE                                     */
+#include <sys/types.h>      /* off_t                                    */
 
-#endif
\ No newline at end of file
+#include "trace.h"          /* trace                                    */
+
+/* Body of a response, shared by HTTP/1 and HTTP/2 */
+typedef struct {
+   int status_code;     /* http status code                     */
+   int fd;              /* body source, file, pack or cgi pipe  */
+   off_t offset;        /* offset of the body in fd             */
+   off_t size;          /* size of the body, -1 for cgi output  */
+   FILE *pipe;          /* cgi process, closed with pclose      */
+   int owned;           /* fd is closed with the content        */
+   const char *header;  /* precomputed headers of a pack entry  */
+   int header_len;      /* length of the precomputed headers    */
+} content;
+
+/* Map the configured packs, call again to swap in rebuilt ones */
+int response_init(const config *conf);
+
+int response(const config *conf, int connection, struct sockaddr_in *client_addr);
+
+/* Open the body of a static route, an error page or a cgi script */
+int open_content(const config *conf, const char *route, content *cont);
+int open_error_content(const config *conf, int status_code, content *cont);
+int open_cgi_content(const config *conf, const char *route, char *params, content *cont);
+void close_content(content *cont);
+void prefetch_content(const content *cont);
+
+/* Access log line, ends the trace of the request */
+void log_response(const config *conf, int status_code, const char *method, const char *route,
+    struct sockaddr_in *client_addr, trace *tr);
+
+/* Access log line of a client resolved once, the streams of an HTTP/2 connection */
+void log_named_response(int status_code, const char *method, const char *route,
+    const char *name, trace *tr);
+
+/* Client name or numeric address, in a static buffer */
+const char * resolve_addr(struct sockaddr_in *addr, int dns_resolve);
+
+#endif
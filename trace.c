@@ -0,0 +1,327 @@
+#include <stdio.h>          /* standard input output                    */
+#include <stdlib.h>         /* standard library                         */
+#include <string.h>         /* string functions                         */
+#include <stdint.h>         /* fixed width integers                     */
+#include <errno.h>          /* error numbers                            */
+#include <pthread.h>        /* process shared mutex                     */
+#include <syslog.h>         /* syslog                                   */
+#include <sys/mman.h>       /* for mmap                                 */
+
+/* Own header */
+#include "trace.h"          /* trace header                             */
+
+/* Static probes, a nop instruction each until a tracer attaches */
+#ifdef HAVE_SDT
+#include <sys/sdt.h>        /* USDT probes                              */
+#define PROBE1(name, a) DTRACE_PROBE1(webserver, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(webserver, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(webserver, name, a, b, c)
+#else
+#define PROBE1(name, a) do { } while (0)
+#define PROBE2(name, a, b) do { } while (0)
+#define PROBE3(name, a, b, c) do { } while (0)
+#endif
+
+/* A request kept in the slowest table */
+typedef struct {
+    uint64_t total_ns;
+    uint64_t ns[TRACE_STAGES];
+    int status_code;
+    char method[8];
+    char route[TRACE_ROUTESIZE];
+    time_t when;
+} trace_entry;
+
+/* Shared by the parent and every forked worker */
+typedef struct {
+    pthread_mutex_t lock;       /* process shared, survives a killed holder */
+    int count;                  /* entries in use                       */
+    uint64_t min_ns;            /* fastest kept request, once full      */
+    trace_entry entries[TRACE_MAXSLOWEST];
+} trace_table;
+
+static const char *stage_names[TRACE_STAGES] = {
+    "recv", "parse", "queue", "open", "cgi", "send", "resolve"
+};
+
+static int log_enabled = 0;         /* timing fields in the access log  */
+static int slowest_size = 0;        /* requests kept, 0 is off          */
+static trace_table *slowest = NULL;
+
+int lock_table();
+void keep_slowest(const trace *tr, int status_code, const char *method, const char *route);
+void update_min();
+void format_stages(const uint64_t *ns, uint64_t total_ns, char *buffer, size_t size);
+int compare_entries(const void *a, const void *b);
+uint64_t diff_ns(const struct timespec *from, const struct timespec *to);
+
+
+int trace_init(int log_fields, int slowest_count)
+{
+    pthread_mutexattr_t attr;
+
+    log_enabled = log_fields;
+    slowest_size = slowest_count > TRACE_MAXSLOWEST ? TRACE_MAXSLOWEST : slowest_count;
+
+    if (slowest_size == 0)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    slowest = mmap(NULL, sizeof(trace_table), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (slowest == MAP_FAILED)
+    {
+        slowest = NULL;
+        return EXIT_FAILURE;
+    }
+
+    /* A worker killed while holding the lock must not wedge the others or the parent */
+    if ( (pthread_mutexattr_init(&attr)) != 0 ||
+         (pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED)) != 0 ||
+         (pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST)) != 0 ||
+         (pthread_mutex_init(&slowest->lock, &attr)) != 0)
+    {
+        munmap(slowest, sizeof(trace_table));
+        slowest = NULL;
+        return EXIT_FAILURE;
+    }
+    pthread_mutexattr_destroy(&attr);
+    return EXIT_SUCCESS;
+}
+
+void trace_begin(trace *tr)
+{
+    memset(tr, 0, sizeof(trace));
+    tr->running = -1;
+    clock_gettime(CLOCK_MONOTONIC, &tr->begin);
+}
+
+void trace_start(trace *tr, trace_stage stage)
+{
+    /* Stages do not nest, the running one ends here */
+    if (tr->running >= 0)
+    {
+        trace_end(tr, tr->running);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &tr->stage_begin);
+    tr->running = stage;
+    PROBE1(stage_start, stage);
+}
+
+void trace_end(trace *tr, trace_stage stage)
+{
+    struct timespec now;
+    uint64_t ns;
+
+    /* Already ended by the next stage or trace_finish */
+    if (tr->running != (int) stage)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ns = diff_ns(&tr->stage_begin, &now);
+    tr->ns[stage] += ns;
+    tr->running = -1;
+    PROBE2(stage_end, stage, ns);
+}
+
+void trace_span(trace *tr, trace_stage stage, const struct timespec *from, const struct timespec *to)
+{
+    uint64_t ns = diff_ns(from, to);
+
+    tr->ns[stage] += ns;
+    PROBE2(stage_end, stage, ns);
+}
+
+uint64_t trace_elapsed(const trace *tr)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return diff_ns(&tr->begin, &now);
+}
+
+void trace_finish(trace *tr, int status_code, const char *method, const char *route)
+{
+    if (tr->running >= 0)
+    {
+        trace_end(tr, tr->running);
+    }
+    tr->total_ns = trace_elapsed(tr);
+    PROBE3(request_done, status_code, tr->total_ns, route);
+
+    if (slowest != NULL)
+    {
+        keep_slowest(tr, status_code, method, route);
+    }
+}
+
+void trace_format(const trace *tr, char *buffer, size_t size)
+{
+    buffer[0] = '\0';
+    if (log_enabled)
+    {
+        format_stages(tr->ns, tr->total_ns, buffer, size);
+    }
+}
+
+void trace_dump()
+{
+    trace_entry entries[TRACE_MAXSLOWEST];
+    char fields[TRACE_FIELDSIZE];
+    char when[32];
+    int count;
+    int i;
+
+    if (slowest == NULL)
+    {
+        return;
+    }
+
+    /* Copy out, the workers keep recording */
+    if ( (lock_table()) != EXIT_SUCCESS)
+    {
+        return;
+    }
+    count = slowest->count;
+    memcpy(entries, slowest->entries, sizeof(trace_entry) * count);
+    pthread_mutex_unlock(&slowest->lock);
+
+    qsort(entries, count, sizeof(trace_entry), compare_entries);
+
+    syslog(LOG_INFO, "Slowest %d requests:", count);
+    for (i = 0; i < count; ++i)
+    {
+        format_stages(entries[i].ns, entries[i].total_ns, fields, sizeof(fields));
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&entries[i].when));
+        syslog(LOG_INFO, "%2d. %s %d %s %s%s", i + 1, when, entries[i].status_code,
+            entries[i].method, entries[i].route, fields);
+    }
+}
+
+
+/* Lock the shared table, taking it over from a holder that died */
+int lock_table()
+{
+    int err;
+    int i;
+
+    err = pthread_mutex_lock(&slowest->lock);
+    if (err == EOWNERDEAD)
+    {
+        /* The holder died mid update, at most one entry is torn, keep its strings terminated */
+        for (i = 0; i < slowest->count; ++i)
+        {
+            slowest->entries[i].method[sizeof(slowest->entries[i].method) - 1] = '\0';
+            slowest->entries[i].route[TRACE_ROUTESIZE - 1] = '\0';
+        }
+        update_min();
+        pthread_mutex_consistent(&slowest->lock);
+        syslog(LOG_WARNING, "Slowest request table recovered from a killed process");
+        return EXIT_SUCCESS;
+    }
+    if (err != 0)
+    {
+        syslog(LOG_ERR, "Slowest request table lock failed!: %s", strerror(err));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Replace the fastest kept request, most requests only read min_ns */
+void keep_slowest(const trace *tr, int status_code, const char *method, const char *route)
+{
+    trace_entry *entry;
+    int i;
+
+    if (slowest->count == slowest_size &&
+        tr->total_ns <= __atomic_load_n(&slowest->min_ns, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+
+    if ( (lock_table()) != EXIT_SUCCESS)
+    {
+        return;
+    }
+
+    if (slowest->count < slowest_size)
+    {
+        entry = &slowest->entries[slowest->count++];
+    }
+    else
+    {
+        entry = &slowest->entries[0];
+        for (i = 1; i < slowest->count; ++i)
+        {
+            if (slowest->entries[i].total_ns < entry->total_ns)
+            {
+                entry = &slowest->entries[i];
+            }
+        }
+        if (entry->total_ns >= tr->total_ns)
+        {
+            entry = NULL;   /* Raced by a slower request */
+        }
+    }
+
+    if (entry != NULL)
+    {
+        entry->total_ns = tr->total_ns;
+        memcpy(entry->ns, tr->ns, sizeof(entry->ns));
+        entry->status_code = status_code;
+        snprintf(entry->method, sizeof(entry->method), "%s", method);
+        snprintf(entry->route, sizeof(entry->route), "%s", route);
+        entry->when = time(NULL);
+    }
+
+    update_min();
+    pthread_mutex_unlock(&slowest->lock);
+}
+
+/* The bar to get in, once the table is full, called with the lock held */
+void update_min()
+{
+    int i;
+
+    if (slowest->count == slowest_size)
+    {
+        slowest->min_ns = slowest->entries[0].total_ns;
+        for (i = 1; i < slowest->count; ++i)
+        {
+            if (slowest->entries[i].total_ns < slowest->min_ns)
+            {
+                slowest->min_ns = slowest->entries[i].total_ns;
+            }
+        }
+    }
+}
+
+void format_stages(const uint64_t *ns, uint64_t total_ns, char *buffer, size_t size)
+{
+    int len;
+    int i;
+
+    len = snprintf(buffer, size, " total=%lluus", (unsigned long long) (total_ns / 1000));
+    for (i = 0; i < TRACE_STAGES && len > 0 && (size_t) len < size; ++i)
+    {
+        len += snprintf(buffer + len, size - len, " %s=%lluus", stage_names[i],
+            (unsigned long long) (ns[i] / 1000));
+    }
+}
+
+/* Slowest first */
+int compare_entries(const void *a, const void *b)
+{
+    const trace_entry *x = a;
+    const trace_entry *y = b;
+
+    return (x->total_ns < y->total_ns) - (x->total_ns > y->total_ns);
+}
+
+uint64_t diff_ns(const struct timespec *from, const struct timespec *to)
+{
+    return (uint64_t) (to->tv_sec - from->tv_sec) * 1000000000ULL + to->tv_nsec - from->tv_nsec;
+}
@@ -0,0 +1,55 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>         /* fixed width integers                     */
+#include <stddef.h>         /* size_t                                   */
+#include <time.h>           /* struct timespec                          */
+
+#define TRACE_MAXSLOWEST 64     /* largest TRACE_SLOWEST                */
+#define TRACE_ROUTESIZE 64      /* route kept for the slowest requests  */
+#define TRACE_FIELDSIZE 256     /* timing fields of an access log line  */
+
+/* Stages of a request, the stage argument of the USDT probes */
+typedef enum {
+    TRACE_RECV = 0,     /* reading the request                  */
+    TRACE_PARSE,        /* request line, headers, hpack         */
+    TRACE_QUEUE,        /* waiting for an I/O pool thread       */
+    TRACE_OPEN,         /* file system or pack lookup           */
+    TRACE_CGI,          /* starting the cgi process             */
+    TRACE_SEND,         /* headers and body, sendfile           */
+    TRACE_RESOLVE,      /* client address for the log           */
+    TRACE_STAGES
+} trace_stage;
+
+/* Timings of one request, starting a stage ends the running one */
+typedef struct {
+    struct timespec begin;          /* request start                    */
+    struct timespec stage_begin;    /* start of the running stage       */
+    int running;                    /* running stage, -1 if none        */
+    uint64_t ns[TRACE_STAGES];      /* time spent in every stage        */
+    uint64_t total_ns;              /* set by trace_finish              */
+} trace;
+
+/* Access log fields and the shared slowest table, call before fork */
+int trace_init(int log_fields, int slowest);
+
+/* USDT probes webserver:stage_start(stage), webserver:stage_end(stage, ns) and
+ * webserver:request_done(status, total_ns, route) fire here when built with <sys/sdt.h> */
+void trace_begin(trace *tr);
+void trace_start(trace *tr, trace_stage stage);
+void trace_end(trace *tr, trace_stage stage);
+
+/* Account a stage timed elsewhere, an I/O pool job */
+void trace_span(trace *tr, trace_stage stage, const struct timespec *from, const struct timespec *to);
+uint64_t trace_elapsed(const trace *tr);
+
+/* End of the response, ends the running stage and keeps the slowest requests */
+void trace_finish(trace *tr, int status_code, const char *method, const char *route);
+
+/* " total=..us recv=..us ..." for the access log, empty if not configured */
+void trace_format(const trace *tr, char *buffer, size_t size);
+
+/* Write the slowest requests of every process to syslog */
+void trace_dump();
+
+#endif
@@ -9,23 +9,89 @@
 #include <pwd.h>            /* for passwd                           */
 #include <sys/wait.h>       /* for waitpid                          */
 #include <syslog.h>         /* syslog                               */
+#include <signal.h>         /* for sigaction                        */
 
 /* Own headers */
 #include "config.h"         /* config header                        */
 #include "response.h"       /* response header                      */
+#include "ratelimit.h"      /* rate limit header                    */
+#include "trace.h"          /* trace header                         */
+
+static volatile sig_atomic_t reload = 0;   /* SIGHUP received   */
+static volatile sig_atomic_t dump = 0;     /* SIGUSR1 received  */
+
+/* A forked process and its client, the parent releases the rate limit slot */
+typedef struct {
+    pid_t pid;                      /* 0 if the entry is free       */
+    struct sockaddr_in addr;        /* client address               */
+} child;
+
+static child *children = NULL;     /* conf->maxconns entries       */
+static int children_size = 0;
+
+/* child functions */
+void add_child(pid_t pid, struct sockaddr_in *client_addr);
+void reap_child(pid_t pid);
+
+/* SIGHUP handler, the packs are reloaded in the main loop */
+void reload_handler(int signum)
+{
+    reload = 1;
+}
+
+/* SIGUSR1 handler, the slowest requests are logged in the main loop */
+void dump_handler(int signum)
+{
+    dump = 1;
+}
+
+/* Remember the client of a forked process */
+void add_child(pid_t pid, struct sockaddr_in *client_addr)
+{
+    int i;
+
+    for (i = 0; i < children_size; ++i)
+    {
+        if (children[i].pid == 0)
+        {
+            children[i].pid = pid;
+            children[i].addr = *client_addr;
+            return;
+        }
+    }
+}
+
+/* The process is gone, however it ended, give back its connection slot */
+void reap_child(pid_t pid)
+{
+    int i;
+
+    for (i = 0; i < children_size; ++i)
+    {
+        if (children[i].pid == pid)
+        {
+            rl_conn_release(&children[i].addr);
+            children[i].pid = 0;
+            return;
+        }
+    }
+}
 
 /* Main function */
 int main(int argc, char **argv)
 {
-    config conf;                        /* config stucture              */
+    config loaded;                      /* config read from the file    */
+    const config *conf;                 /* shared read only config      */
     struct passwd *pwd;                 /* password stucture            */
 
     int sockfd;                         /* server socket                */
     int connection;                     /* client connection socket     */
     int conn_cnt = 0;                   /* number of active connections */
+    pid_t pid;                          /* forked or reaped process id  */
 
     struct sockaddr_in server_addr;     /* server address structure     */
     struct sockaddr_in client_addr;     /* client address structure     */
+    struct sigaction sa;                /* signal action structure      */
 
     /* Check the config file argument */
     if (argc != 2)
@@ -35,14 +101,18 @@ int main(int argc, char **argv)
     }
 
     /* Load config */
-    if ( (load_config(argv[1], &conf)) != EXIT_SUCCESS)
+    if ( (load_config(argv[1], &loaded)) != EXIT_SUCCESS)
     {
         fprintf(stderr, "Loading config from file is failed!\n");
         return(EXIT_FAILURE);
     }
+    if ( (conf = config_snapshot(&loaded)) == NULL)
+    {
+        return(EXIT_FAILURE);
+    }
 
     /* Get the user id */
-    pwd = getpwnam(conf.user);
+    pwd = getpwnam(conf->user);
     if (pwd == NULL)
     {
         fprintf(stderr, "User name is not valid!\n");
@@ -78,7 +148,7 @@ int main(int argc, char **argv)
     memset(&server_addr, 0, sizeof(server_addr)); /* Write zeros to the server_addr struct */
     server_addr.sin_family = AF_INET;  /* Address family */
     server_addr.sin_addr.s_addr = htonl(INADDR_ANY);  /* IP address */
-    server_addr.sin_port = htons(conf.port);  /* Port number */
+    server_addr.sin_port = htons(conf->port);  /* Port number */
 
     /* Bind the server socket
      *  sockfd          socket descriptor
@@ -104,22 +174,76 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
+    /* Shared rate limit table, inherited by the forked processes */
+    if ( (rl_init(conf)) != EXIT_SUCCESS)
+    {
+        fprintf(stderr, "Rate limit initialization failed!\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Clients of the forked processes, one per connection */
+    children_size = conf->maxconns;
+    children = calloc(children_size, sizeof(child));
+    if (children == NULL)
+    {
+        fprintf(stderr, "Process table allocation failed!\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Shared slowest request table, inherited by the forked processes */
+    if ( (trace_init(conf->trace_log, conf->trace_slowest)) != EXIT_SUCCESS)
+    {
+        fprintf(stderr, "Trace initialization failed!\n");
+        return EXIT_FAILURE;
+    }
+
     /* Print the config values for checking */
-    printf("Port number: %d\n", conf.port);
-    printf("Number of clients: %d\n", conf.maxconns);
-    printf("User name: %s\n", conf.user);
-    printf("Root directory path: %s\n", conf.root_dir);
-    printf("Error directory path: %s\n", conf.err_dir);
-    printf("CGI command: %s\n", conf.cgi_cmd);
-    printf("CGI directory path: %s\n", conf.cgi_dir);
-    printf("SysLog name: %s\n", conf.syslog_name);
-    printf("DNS resolution: %d\n", conf.dns);
+    printf("Port number: %d\n", conf->port);
+    printf("Number of clients: %d\n", conf->maxconns);
+    printf("User name: %s\n", conf->user);
+    printf("Root directory path: %s\n", conf->root_dir);
+    printf("Error directory path: %s\n", conf->err_dir);
+    printf("CGI command: %s\n", conf->cgi_cmd);
+    printf("CGI directory path: %s\n", conf->cgi_dir);
+    printf("SysLog name: %s\n", conf->syslog_name);
+    printf("DNS resolution: %d\n", conf->dns);
+    printf("Connections per client: %d\n", conf->rate_conns);
+    printf("Static requests per second: %d (burst %d)\n", conf->rate_static, conf->rate_static_burst);
+    printf("CGI requests per second: %d (burst %d)\n", conf->rate_cgi, conf->rate_cgi_burst);
+    printf("File system threads: %d (queue %d)\n", conf->io_threads, conf->io_queue);
+    printf("Stage timings in log: %d\n", conf->trace_log);
+    printf("Slowest requests kept: %d\n", conf->trace_slowest);
     printf("Webserver started with these paramaters!\n");
 
     /* Open syslog */
-    openlog(conf.syslog_name, LOG_PID, LOG_DAEMON);
+    openlog(conf->syslog_name, LOG_PID, LOG_DAEMON);
     syslog(LOG_INFO, "Webserver started!");
 
+    /* Map the pack files */
+    if ( (response_init(conf)) != EXIT_SUCCESS)
+    {
+        fprintf(stderr, "Loading pack files is failed!\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Reload the pack files on SIGHUP, without SA_RESTART to interrupt accept */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = reload_handler;
+    sigemptyset(&sa.sa_mask);
+    if ( (sigaction(SIGHUP, &sa, NULL)) == -1)
+    {
+        fprintf(stderr, "Signal handler set failed!: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    /* Log the slowest requests on SIGUSR1 */
+    sa.sa_handler = dump_handler;
+    if ( (sigaction(SIGUSR1, &sa, NULL)) == -1)
+    {
+        fprintf(stderr, "Signal handler set failed!: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
     /* Daemonize
      *  -1              don't change the working directory
      *  0               redirects  standard input, standard output and standard error to /dev/null
@@ -146,12 +270,32 @@ int main(int argc, char **argv)
     /* The main loop of the webserver */
     while (1)
     {
+        /* Swap in the rebuilt packs, running processes keep their old mapping */
+        if (reload)
+        {
+            reload = 0;
+            if ( (response_init(conf)) == EXIT_SUCCESS)
+            {
+                syslog(LOG_INFO, "Pack files reloaded");
+            }
+        }
+
+        if (dump)
+        {
+            dump = 0;
+            trace_dump();
+        }
+
         /* No connection avaliable, wait for one process */
-        if (conn_cnt >= conf.maxconns)
+        if (conn_cnt >= conf->maxconns)
         {
             syslog(LOG_NOTICE, "The webserver reach the connection limit");   
-            waitpid(-1, NULL, 0);
-            --conn_cnt;
+            if ( (pid = waitpid(-1, NULL, 0)) > 0)
+            {
+                reap_child(pid);
+                --conn_cnt;
+            }
+            continue;
         }
 
         /* Accept the connections on the server socket
@@ -163,15 +307,38 @@ int main(int argc, char **argv)
 
         if (connection < 0)
         {
-            syslog(LOG_ERR, "Server socket accept failed!: %s", strerror(errno));
+            if (errno != EINTR)
+            {
+                syslog(LOG_ERR, "Server socket accept failed!: %s", strerror(errno));
+            }
+            continue;
+        }
+
+        /* Collect the finished processes before counting the connections of the client */
+        while ( (pid = waitpid(-1, NULL, WNOHANG)) > 0)
+        {
+            reap_child(pid);
+            --conn_cnt;
+        }
+
+        if ( (rl_conn_acquire(&client_addr)) != 0)
+        {
+            /* Too many connections from this client */
+            rl_send_reject(connection, 503, 1);
+            shutdown(connection, SHUT_RDWR);
+            close(connection);
         }
         else
         {
-            ++conn_cnt;
             /* Child process */
-            if (fork() == 0)
+            if ( (pid = fork()) == 0)
             {
-                openlog(conf.syslog_name, LOG_PID, LOG_DAEMON);
+                /* The reload and the dump are for the parent, they must not interrupt a response */
+                sa.sa_handler = SIG_IGN;
+                sigaction(SIGHUP, &sa, NULL);
+                sigaction(SIGUSR1, &sa, NULL);
+
+                openlog(conf->syslog_name, LOG_PID, LOG_DAEMON);
                 response(conf, connection, &client_addr);
                 shutdown(connection, SHUT_RDWR); /* close(connection) in all process */
                 closelog();
@@ -179,9 +346,16 @@ int main(int argc, char **argv)
             }
 
             /* Parent process */
-            while ( (waitpid(-1, NULL, WNOHANG)) > 0)  /* Collect the finished process if exists */
+            if (pid < 0)
             {
-                --conn_cnt;
+                syslog(LOG_ERR, "Fork failed!: %s", strerror(errno));
+                rl_conn_release(&client_addr);
+                close(connection);
+            }
+            else
+            {
+                add_child(pid, &client_addr);
+                ++conn_cnt;
             }
         } /* end else */
     } /* end while */